@@ -16,6 +16,7 @@
 #include "all_models.h"
 
 void test(IReader_t* treader, FlyModel_t* model, int thread_num, FILE* output_file);
+int compile_gbdt(const GBDT_t* model, const char* output_file);
 
 void show_help() {
     fprintf(stderr, 
@@ -24,9 +25,12 @@ void show_help() {
         -f --file      : input training file. \n\
         -T --test      : test file. \n\
         -b --binary    : if this is set, input will use binary_reader. \n\
+        -r --stream    : stream text input from disk instead of loading it into memory. \n\
         -S --save      : save model to file. this config must combine with -f\n\
         -L --load      : load model from file \n\
-        -M --model     : [lr, cglr, mnn, gbdt] is available, default is lr. \n\
+        -M --model     : [lr, cglr, mnn, gbdt, gbdt_so] is available, default is lr. \n\
+                            gbdt_so is a compiled gbdt model, -L loads the .so file. \n\
+        -C --compile   : compile gbdt model to C++ source, or to shared object if file ends with .so \n\
         -o --output    : output file, output the predict result of input training data. \n\
         -c --config    : configs. \n\
                             use -S [default=fly] to config Fly itself. \n\
@@ -44,11 +48,12 @@ int main(int argc, char** argv) {
         srand((int)time(0));
 
         int opt;
-        char* opt_string = "dS:L:hHf:M:o:c:s:t:bT:p:N";
+        char* opt_string = "dS:L:C:hHf:M:o:c:s:t:brT:p:N";
         static struct option long_options[] = {
             {"file", required_argument, NULL, 'f'},
             {"load", required_argument, NULL, 'L'},
             {"save", required_argument, NULL, 'S'},
+            {"compile", required_argument, NULL, 'C'},
             {"help", no_argument, NULL, 'h'},
             {"model", required_argument, NULL, 'M'},
             {"output", required_argument, NULL, 'o'},
@@ -56,6 +61,7 @@ int main(int argc, char** argv) {
             {"section", required_argument, NULL, 's'},
             {"transform", required_argument, NULL, 't'},
             {"binary", required_argument, NULL, 'b'},
+            {"stream", no_argument, NULL, 'r'},
             {"test", required_argument, NULL, 'T'},
             {"pipes", required_argument, NULL, 'p'},
             {"debug", required_argument, NULL, 'd'},
@@ -69,7 +75,9 @@ int main(int argc, char** argv) {
         const char* model_name = "lr";
         const char* model_save_file = NULL;
         const char* model_load_file = NULL;
+        const char* model_compile_file = NULL;
         bool binary_mode = false;
+        bool stream_mode = false;
         Config_t model_config;
         const char* config_section = NULL;
         int thread_num = 5;
@@ -90,6 +98,11 @@ int main(int argc, char** argv) {
                     LOG_NOTICE("load model from [%s]", model_load_file);
                     break;
 
+                case 'C':
+                    model_compile_file = optarg;
+                    LOG_NOTICE("compile model to [%s]", model_compile_file);
+                    break;
+
                 case 'f':
                     input_file = optarg;
                     LOG_NOTICE("Input file: [%s]", input_file);
@@ -100,6 +113,11 @@ int main(int argc, char** argv) {
                     LOG_NOTICE("use binary reader to read input.");
                     break;
 
+                case 'r':
+                    stream_mode = true;
+                    LOG_NOTICE("stream text input.");
+                    break;
+
                 case 'M':
                     model_name = optarg;
                     LOG_NOTICE("Model: %s", model_name);
@@ -167,6 +185,8 @@ int main(int argc, char** argv) {
             model = new MultiNN_t(model_config, config_section);
         } else if (strcmp(model_name, "gbdt")==0) {
             model = new GBDT_t(model_config, config_section);
+        } else if (strcmp(model_name, "gbdt_so")==0) {
+            model = new CompiledGBDT_t(model_config, config_section);
         } else if (strcmp(model_name, "meta")==0) {
             model = new MetaModel_t(model_config, config_section);
         } else if (strcmp(model_name, "knn") == 0) {
@@ -198,22 +218,32 @@ int main(int argc, char** argv) {
 
         } else {
             if (input_file) {
-                train_data_reader = new TextReader_t();
-                train_data_reader->set(input_file);
+                TextReader_t* reader = new TextReader_t();
+                reader->set_streaming(stream_mode);
+                reader->set(input_file);
+                train_data_reader = reader;
             }
             if (test_file) {
                 if (test_and_train_is_same) {
                     test_data_reader = train_data_reader;
                 } else {
-                    test_data_reader = new TextReader_t();
-                    test_data_reader->set(test_file);
+                    TextReader_t* reader = new TextReader_t();
+                    reader->set_streaming(stream_mode);
+                    reader->set(test_file);
+                    test_data_reader = reader;
                 }
             }
         }
 
         // load model at first.
         // which can make continuous-trainging.
-        if (model_load_file) {
+        CompiledGBDT_t* compiled_model = dynamic_cast<CompiledGBDT_t*>(model);
+        if (model_load_file && compiled_model) {
+            LOG_NOTICE("Compiled model load from [%s]", model_load_file);
+            if (!compiled_model->load(model_load_file)) {
+                return -1;
+            }
+        } else if (model_load_file) {
             LOG_NOTICE("Model load from [%s]", model_load_file);
             FILE* model_file = fopen(model_load_file, "r");
             if (!model_file) {
@@ -244,6 +274,17 @@ int main(int argc, char** argv) {
             fclose(model_file);
             LOG_NOTICE("Model save completed.");
         }
+
+        if (model_compile_file) {
+            GBDT_t* gbdt = dynamic_cast<GBDT_t*>(model);
+            if (gbdt == NULL) {
+                LOG_ERROR("Only gbdt model can be compiled.");
+                return -1;
+            }
+            if (compile_gbdt(gbdt, model_compile_file) != 0) {
+                return -1;
+            }
+        }
      
         // simple test.
         if (test_data_reader != NULL) {
@@ -283,9 +324,45 @@ int main(int argc, char** argv) {
     return 0;
 }
 
+/*
+ * write C++ source of model, then build it by g++ if output_file ends with .so.
+ */
+int compile_gbdt(const GBDT_t* model, const char* output_file) {
+    string so_file;
+    string source_file = output_file;
+    size_t len = source_file.size();
+    if (len > 3 && source_file.substr(len - 3) == ".so") {
+        so_file = source_file;
+        source_file = so_file + ".cc";
+    }
+
+    Timer timer;
+    timer.begin();
+    FILE* stream = fopen(source_file.c_str(), "w");
+    if (stream == NULL) {
+        LOG_ERROR("Cannot open file [%s] to write model code.", source_file.c_str());
+        return -1;
+    }
+    model->write_code(stream);
+    fclose(stream);
+    LOG_NOTICE("Model code written to [%s]", source_file.c_str());
+
+    if (!so_file.empty()) {
+        string cmd = "g++ -O2 -shared -fPIC -o " + so_file + " " + source_file;
+        LOG_NOTICE("Build compiled model: %s", cmd.c_str());
+        if (system(cmd.c_str()) != 0) {
+            LOG_ERROR("Build compiled model [%s] failed.", so_file.c_str());
+            return -1;
+        }
+    }
+    timer.end();
+    LOG_NOTICE("Model compile completed. tm=%.2fs", timer.cost_time());
+    return 0;
+}
+
 struct TestJob_t {
     int job_id;
-    PCPool_t<Instance_t>* pool;
+    PCPool_t<InstanceBatch_t>* pool;
     IReader_t* reader;
     FArray_t<ResultPair_t> ans_list;
     FlyModel_t* model;
@@ -298,34 +375,47 @@ void* thread_test(void* c) {
         LOG_NOTICE("thread[%d] : I am a reader.", job.job_id);
         size_t c = 0;
         while (1) {
-            Instance_t* cell = job.pool->begin_put();
-            if (!job.reader->read(cell)) {
-                job.pool->end_put(false);
+            InstanceBatch_t* cell = job.pool->begin_put();
+            size_t n = cell->fill(job.reader);
+            if (n == 0) {
+                job.pool->end_put(cell, false);
                 break;
             }
-            if (c % 2000000 == 0) {
-                LOG_NOTICE("complete %d puts.", c);
+            if (c / 2000000 != (c + n) / 2000000) {
+                LOG_NOTICE("complete %d puts.", c + n);
             }
-            job.pool->end_put();
-            c ++;
+            job.pool->end_put(cell);
+            c += n;
         }
         LOG_NOTICE("reader: load over. count=%d", c);
         job.pool->set_putting(false);
     } else {
         LOG_NOTICE("thread[%d] : I am a worker.", job.job_id);
         job.ans_list.clear();
-        Instance_t item;
-        uint32_t order_id;
-        while (job.pool->get(&item, &order_id)) {
-            float ans;
-            ans = job.model->predict(item);
-            job.ans_list.push_back(ResultPair_t(item.label, ans));
+        vector<float> scores(InstanceBatch_t::DefaultCapacity);
+        InstanceBatch_t* batch;
+        uint32_t batch_id;
+        while ((batch = job.pool->begin_get(&batch_id)) != NULL) {
+            size_t begin = job.ans_list.size();
+            if (scores.size() < batch->size()) {
+                scores.resize(batch->size());
+            }
+            job.model->predict_batch(*batch, batch->size(), &scores[0]);
+            for (size_t i=0; i<batch->size(); ++i) {
+                job.ans_list.push_back(ResultPair_t(batch->label(i), scores[i]));
+            }
 
             if (job.output_file) {
+                // all batches are full except the last one.
+                uint32_t order_id = batch_id * batch->capacity();
                 FILE* of = job.output_file->borrow();
-                fprintf(of, "%f\t%f\t%d\n", item.label, ans, order_id);
+                for (size_t i=0; i<batch->size(); ++i) {
+                    const ResultPair_t& res = job.ans_list[begin + i];
+                    fprintf(of, "%f\t%f\t%d\n", res.target, res.output, order_id + i);
+                }
                 job.output_file->give_back();
             }
+            job.pool->end_get(batch);
         }
         LOG_NOTICE("thread[%d] : over. %d processed.", job.job_id, job.ans_list.size());
     }
@@ -336,7 +426,7 @@ void test(IReader_t* treader, FlyModel_t* model, int thread_num, FILE* output_fi
     // 1 reader + thread_num workers.
     thread_num += 1;
     TestJob_t* jobs = new TestJob_t[thread_num];
-    PCPool_t<Instance_t> pool(2000000);
+    PCPool_t<InstanceBatch_t> pool(2000000 / InstanceBatch_t::DefaultCapacity);
     ThreadData_t<FILE*> shared_output(output_file);
     for (int i=0; i<thread_num; ++i) {
         jobs[i].pool = &pool;
@@ -351,7 +441,8 @@ void test(IReader_t* treader, FlyModel_t* model, int thread_num, FILE* output_fi
     }
     jobs[0].reader = treader;
 
-    multi_thread_jobs(thread_test, jobs, thread_num, thread_num);
+    ThreadPool_t thread_pool(thread_num);
+    thread_pool.run_jobs(thread_test, jobs, thread_num);
     LOG_NOTICE("thread work is over.");
     FArray_t<ResultPair_t> total_list;
     for (int i=0; i<thread_num; ++i) {
@@ -6,12 +6,30 @@
  **/
 #include <fly_data.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 
 BinaryReader_t::
 BinaryReader_t(const char* filename):
+    _stream(NULL),
     _cur_id(0),
     _size(0),
-    _theta_num(0)
+    _theta_num(0),
+    _is_stat(false),
+    _has_meta(false),
+    _label_pending(false),
+    _pending_label(0),
+    _data(NULL),
+    _data_size(0),
+    _data_begin(0),
+    _data_end(0),
+    _pos(0),
+    _index_map(NULL),
+    _index_map_size(0),
+    _offsets(NULL)
 {
     if (filename != NULL) {
         set(filename);
@@ -20,9 +38,7 @@ BinaryReader_t(const char* filename):
 
 BinaryReader_t::
 ~BinaryReader_t() {
-    if (_stream) {
-        fclose(_stream);
-    }
+    _close();
 }
 
 size_t 
@@ -48,97 +64,394 @@ BinaryReader_t::percentage() const {
 
 void 
 BinaryReader_t::set(const char* filename) {
-    _is_stat = false;
+    _close();
     LOG_NOTICE("BinaryReader_t open [%s]", filename);
-    _stream = fopen(filename, "rb");
-    if (_stream == NULL) {
+
+    if (strcmp(filename, "/dev/stdin") == 0) {
+        _open_stream(filename);
+        return ;
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
         LOG_ERROR("Cannot open file [%s]", filename);
         throw std::runtime_error(string("Cannot open file : ") + string(filename));
     }
+    struct stat st;
+    fstat(fd, &st);
+    _data_size = st.st_size;
+    if (_data_size > 0) {
+        void* p = mmap(NULL, _data_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            LOG_ERROR("Cannot mmap file [%s]", filename);
+            throw std::runtime_error(string("Cannot mmap file : ") + string(filename));
+        }
+        madvise(p, _data_size, MADV_SEQUENTIAL);
+        _data = (const char*)p;
+    }
+    close(fd);
+
+    _data_begin = 0;
+    _data_end = _data_size;
+    _has_meta = _meta.parse(_data, _data_size);
+    if (_has_meta) {
+        _data_begin = _meta.data_begin();
+        _data_end = _meta.data_end();
+        _size = _meta.record_num();
+        _theta_num = _meta.dim();
+        _is_stat = true;
+        LOG_NOTICE("read header: %llu records. theta_num=%d", 
+                (unsigned long long)_size, _theta_num);
+    }
+    _pos = _data_begin;
 
-    if (strcmp(filename, "/dev/stdin") != 0) {
+    if (!_load_index(filename) && !_has_meta) {
         stat();
-    } else {
-        LOG_NOTICE("Input is /dev/stdin. Streming ignore stat.");
     }
 }
 
 void 
 BinaryReader_t::stat() {
-    if (_is_stat) {
+    if (_is_stat || _stream) {
         return ;
     }
-    _is_stat = true;
+    _scan();
+    reset();
+}
+
+void 
+BinaryReader_t::_scan() {
     LOG_NOTICE("DO_STAT ON BINARY FILE.");
-    fseek(_stream, 0, SEEK_END);
-    size_t total_file_size = ftell(_stream);
     int percentage = 0;
 
     _cur_id = 0;
     _size = 0;
     _theta_num = 0;
+    _offset_buffer.clear();
     LOG_NOTICE("Preprocess(Stat theta_num and item_num)..");
-    fseek(_stream, 0, SEEK_SET);
-    while ( !feof(_stream) ) {
-        Instance_t new_item;
-        new_item.read_binary(_stream);
+    size_t pos = _data_begin;
+    InstanceView_t view;
+    while (pos < _data_end) {
+        size_t next_pos;
+        if (!_parse(pos, &view, &next_pos)) {
+            LOG_ERROR("bad binary record at offset %llu", pos);
+            throw std::runtime_error("Bad binary record.");
+        }
+        _offset_buffer.push_back(pos);
+        pos = next_pos;
 
         // stat _size and _theta_num
         _size ++;
-        for (size_t i=0; i<new_item.features.size(); ++i) {   
-            int idx = new_item.features[i].index;
+        for (size_t i=0; i<view.feature_num; ++i) {   
+            int idx = view.features[i].index;
             if (idx >= _theta_num) {
                 _theta_num = idx + 1;
             }
         }
 
-        size_t process_size = ftell(_stream);
-        int cur_per = int(process_size * 100.0f / total_file_size);
+        int cur_per = int(pos * 100.0f / _data_end);
         if (cur_per > percentage) {
             percentage = cur_per;
             fprintf(stderr, "%cPreprocessing complete %d%% [%d/%d mb] [%lu record(s)]", 
-                    13, percentage, process_size>>20, total_file_size>>20, _size);
+                    13, percentage, pos>>20, _data_end>>20, _size);
             fflush(stderr);
         }
     }
     fprintf(stderr, "\n");
     LOG_NOTICE("processed: %llu records. theta_num=%d", _size, _theta_num);
-    reset();
+    _offsets = _offset_buffer.size()>0 ? &_offset_buffer[0] : NULL;
+    _is_stat = true;
 }
 
 void 
 BinaryReader_t::reset() {
-    fseek(_stream, 0, SEEK_SET);
+    if (_stream) {
+        fseek(_stream, 0, SEEK_SET);
+    }
+    _pos = _data_begin;
     _cur_id = 0;
 }
 
 bool 
 BinaryReader_t::read(Instance_t* item) {
-    if ( !feof(_stream) ) {
-        item->read_binary(_stream);
+    if (_stream) {
+        if (_has_meta && _cur_id >= _size) {
+            return false;
+        }
+        if (_label_pending) {
+            item->label = _pending_label;
+            item->features.read(_stream);
+            _label_pending = false;
+        } else if ( !feof(_stream) ) {
+            item->read_binary(_stream);
+        } else {
+            return false;
+        }
         _cur_id ++;
         return true;
-    } else {
+    }
+
+    InstanceView_t view;
+    if (!read_view(&view)) {
         return false;
     }
+    view.copy_to(item);
+    return true;
+}
+
+bool 
+BinaryReader_t::read_view(InstanceView_t* view) {
+    if (_stream) {
+        return IReader_t::read_view(view);
+    }
+    size_t next_pos;
+    if (!_parse(_pos, view, &next_pos)) {
+        return false;
+    }
+    _pos = next_pos;
+    _cur_id ++;
+    return true;
+}
+
+void 
+BinaryReader_t::get_view(size_t row_id, InstanceView_t* view) {
+    if (_offsets == NULL) {
+        // header without index: offsets are built once.
+        _scan();
+    }
+    if (row_id >= _size) {
+        throw std::runtime_error("get_view() out of range.");
+    }
+    size_t next_pos;
+    if (!_parse(_offsets[row_id], view, &next_pos)) {
+        throw std::runtime_error("Bad binary record.");
+    }
+}
+
+void 
+BinaryReader_t::write_index(const char* filename, 
+        const vector<uint64_t>& offsets, size_t dim, size_t data_size) 
+{
+    string index_file = string(filename) + ".idx";
+    FILE* stream = fopen(index_file.c_str(), "wb");
+    if (stream == NULL) {
+        throw std::runtime_error(string("Cannot open file to write : ") + index_file);
+    }
+    BinaryIndexHeader_t header;
+    header.magic = BinaryIndexHeader_t::Magic;
+    header.version = BinaryIndexHeader_t::Version;
+    header.record_num = offsets.size();
+    header.dim = dim;
+    header.data_size = data_size;
+    fwrite(&header, sizeof(header), 1, stream);
+    if (offsets.size() > 0) {
+        fwrite(&offsets[0], sizeof(uint64_t), offsets.size(), stream);
+    }
+    fclose(stream);
+    LOG_NOTICE("write index [%s] record_num=%llu dim=%llu", 
+            index_file.c_str(), (unsigned long long)offsets.size(), (unsigned long long)dim);
 }
 
+void 
+BinaryReader_t::_close() {
+    if (_stream) {
+        fclose(_stream);
+        _stream = NULL;
+    }
+    if (_data) {
+        munmap((void*)_data, _data_size);
+        _data = NULL;
+    }
+    if (_index_map) {
+        munmap(_index_map, _index_map_size);
+        _index_map = NULL;
+    }
+    _data_size = 0;
+    _data_begin = 0;
+    _data_end = 0;
+    _has_meta = false;
+    _label_pending = false;
+    _meta.clear();
+    _index_map_size = 0;
+    _offsets = NULL;
+    _offset_buffer.clear();
+    _is_stat = false;
+    _size = 0;
+    _theta_num = 0;
+    _pos = 0;
+    _cur_id = 0;
+}
+
+void 
+BinaryReader_t::_open_stream(const char* filename) {
+    _stream = fopen(filename, "rb");
+    if (_stream == NULL) {
+        LOG_ERROR("Cannot open file [%s]", filename);
+        throw std::runtime_error(string("Cannot open file : ") + string(filename));
+    }
+
+    // stream can not be peeked, the first 4 bytes are the magic or the first label.
+    char buffer[sizeof(FileMeta_t::Header_t)];
+    if (fread(buffer, sizeof(uint32_t), 1, _stream) == 1) {
+        uint32_t magic;
+        memcpy(&magic, buffer, sizeof(magic));
+        if (magic == FileMeta_t::HeaderMagic) {
+            fread(buffer + sizeof(uint32_t), sizeof(buffer) - sizeof(uint32_t), 1, _stream);
+            _has_meta = _meta.parse_header(buffer, sizeof(buffer));
+            for (size_t i=sizeof(buffer); i<_meta.data_begin(); ++i) {
+                fgetc(_stream);
+            }
+            _size = _meta.record_num();
+            _theta_num = _meta.dim();
+            _is_stat = true;
+        } else {
+            memcpy(&_pending_label, buffer, sizeof(float));
+            _label_pending = true;
+        }
+    }
+    LOG_NOTICE("Input is /dev/stdin. Streming ignore stat.");
+}
+
+bool 
+BinaryReader_t::_load_index(const char* filename) {
+    string index_file = string(filename) + ".idx";
+    int fd = open(index_file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size_t index_size = st.st_size;
+    if (index_size < sizeof(BinaryIndexHeader_t)) {
+        close(fd);
+        return false;
+    }
+    void* p = mmap(NULL, index_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+
+    const BinaryIndexHeader_t* header = (const BinaryIndexHeader_t*)p;
+    if (header->magic != BinaryIndexHeader_t::Magic
+            || header->version != BinaryIndexHeader_t::Version
+            || header->data_size != _data_size
+            || index_size != sizeof(BinaryIndexHeader_t) + header->record_num * sizeof(uint64_t)) 
+    {
+        LOG_NOTICE("index [%s] is stale or broken, ignored.", index_file.c_str());
+        munmap(p, index_size);
+        return false;
+    }
+
+    _index_map = p;
+    _index_map_size = index_size;
+    _offsets = (const uint64_t*)(header + 1);
+    _size = header->record_num;
+    _theta_num = header->dim;
+    _is_stat = true;
+    LOG_NOTICE("load index [%s]: %llu records. theta_num=%d", 
+            index_file.c_str(), (unsigned long long)_size, _theta_num);
+    return true;
+}
+
+bool 
+BinaryReader_t::_parse(size_t pos, InstanceView_t* view, size_t* next_pos) const {
+    // record : float label, size_t feature_num, IndValue_t features[feature_num]
+    static const size_t HeadSize = sizeof(float) + sizeof(size_t);
+    if (pos + HeadSize > _data_end) {
+        return false;
+    }
+    const char* p = _data + pos;
+    memcpy(&view->label, p, sizeof(float));
+    memcpy(&view->feature_num, p + sizeof(float), sizeof(size_t));
+    if (view->feature_num > (_data_end - pos - HeadSize) / sizeof(IndValue_t)) {
+        return false;
+    }
+    view->features = (const IndValue_t*)(p + HeadSize);
+    *next_pos = pos + HeadSize + view->feature_num * sizeof(IndValue_t);
+    return true;
+}
+
+
+/*
+ * max index of "label index:value ..." line, -1 if none.
+ * values are not parsed, for the first pass of streaming.
+ */
+static int __max_feature_index(const char* line) {
+    int max_index = -1;
+    const char* p = line;
+    while (*p && *p!='\n') {
+        while (*p==' ' || *p=='\t' || *p=='\r') {
+            ++p;
+        }
+        const char* token = p;
+        while (*p && *p!=':' && *p!=' ' && *p!='\t' && *p!='\n' && *p!='\r') {
+            ++p;
+        }
+        if (*p == ':') {
+            int idx;
+            if (parse_int(token, &idx) != token && idx > max_index) {
+                max_index = idx;
+            }
+            while (*p && *p!=' ' && *p!='\t' && *p!='\n' && *p!='\r') {
+                ++p;
+            }
+        }
+    }
+    return max_index;
+}
+
+/*
+ * lines in [begin, end) of text file.
+ */
+struct TextReader_t::ChunkJob_t {
+    TextReader_t*   reader;
+    const char*     begin;
+    const char*     end;
+    size_t          line_num;
+    int             theta_num;
+    CSRDataset_t    rows;
+    DenseDataset_t  dense;
+    string          error;
+};
 
 TextReader_t::
 TextReader_t(const char* filename, size_t roll_size):
     _roll_size(roll_size),
     _cur_id(0),
+    _thread_num(1),
     _theta_num(0),
     _feature_mode(TFM_AutoDetected),
-    _buffer(8192),
-    _compact_buffer(8192)
+    _rows(8192),
+    _streaming(false),
+    _data(NULL),
+    _data_size(0),
+    _pos(0),
+    _size(0)
 {
+    long cpu_num = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_num > 0) {
+        _thread_num = cpu_num;
+    }
     if (filename != NULL) {
         set(filename);
     }
 }
 
-TextReader_t::~TextReader_t() {}
+TextReader_t::~TextReader_t() {
+    _unmap();
+}
+
+void 
+TextReader_t::_unmap() {
+    if (_data) {
+        munmap((void*)_data, _data_size);
+    }
+    _data = NULL;
+    _data_size = 0;
+    _pos = 0;
+}
 
 void 
 TextReader_t::set(const char* filename) {
@@ -149,103 +462,302 @@ TextReader_t::set(const char* filename) {
         LOG_ERROR("Cannot open file [%s]", filename);
         throw std::runtime_error(string("Cannot open file : ") + string(filename));
     }
+    _unmap();
+
+    // map regular file, read others (pipes) into memory.
+    const char* data = NULL;
+    size_t data_size = 0;
+    vector<char> stream_data;
+    struct stat st;
+    if (fstat(fileno(_stream), &st)==0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        data_size = st.st_size;
+        void* p = mmap(NULL, data_size, PROT_READ, MAP_PRIVATE, fileno(_stream), 0);
+        if (p == MAP_FAILED) {
+            fclose(_stream);
+            _stream = NULL;
+            LOG_ERROR("Cannot mmap file [%s]", filename);
+            throw std::runtime_error(string("Cannot mmap file : ") + string(filename));
+        }
+        data = (const char*)p;
+    } else if (_streaming) {
+        fclose(_stream);
+        _stream = NULL;
+        LOG_ERROR("Streaming needs a regular file [%s]", filename);
+        throw std::runtime_error(string("Streaming needs a regular file : ") + string(filename));
+    } else {
+        char block[65536];
+        size_t n;
+        while ((n = fread(block, 1, sizeof(block), _stream)) > 0) {
+            stream_data.insert(stream_data.end(), block, block + n);
+        }
+        data_size = stream_data.size();
+        data = data_size>0 ? &stream_data[0] : NULL;
+    }
+    fclose(_stream);
+    _stream = NULL;
 
-    fseek(_stream, 0, SEEK_END);
-    size_t total_file_size = ftell(_stream);
-    fseek(_stream, 0, SEEK_SET);
-    int percentage = 0;
-
-    // load all data into memory.
     _cur_id = 0;
-    _buffer.clear();
-    _compact_buffer.clear();
+    _rows.clear();
+    _dense.clear();
+    _dense.set_dim(0);
     _theta_num = 0;
-    char line[MaxLineLength];
-    size_t c = 0;
+    _size = 0;
 
-    while (fgets(line, sizeof(line), _stream)) {
+    if (data_size > 0) {
+        // mode and dim of Values come from the first line.
+        const char* first_end = (const char*)memchr(data, '\n', data_size);
+        size_t first_len = first_end ? (first_end - data) : data_size;
+        if (first_len >= MaxLineLength) {
+            first_len = MaxLineLength - 1;
+        }
+        char line[MaxLineLength];
+        memcpy(line, data, first_len);
+        line[first_len] = 0;
         if (_feature_mode == TFM_AutoDetected) {
             _feature_mode = auto_detect_mode(line);
         }
+        if (_feature_mode == TFM_Values) {
+            CompactInstance_t compact_item(0);
+            _theta_num = compact_item.parse_item(line, " ");
+            LOG_NOTICE("ModeValues : read first line and get theta_num = %d", _theta_num);
+            _dense.set_dim(_theta_num);
+        }
 
-        if (_feature_mode == TFM_IndValue) {
-            Instance_t new_item;
-            new_item.parse_item(line);
-            _buffer.push_back(new_item);
-            for (size_t i=0; i<new_item.features.size(); ++i) {   
-                int idx = new_item.features[i].index;
-                if (idx >= _theta_num) {
-                    _theta_num = idx + 1;
-                }
+        // cut file into chunks at line ends.
+        size_t chunk_num = _thread_num * 4;
+        vector<ChunkJob_t> jobs;
+        const char* begin = data;
+        for (size_t i=1; i<=chunk_num && begin < data + data_size; ++i) {
+            const char* end = data + data_size * i / chunk_num;
+            if (end < begin) {
+                end = begin;
+            }
+            if (i < chunk_num) {
+                const char* nl = (const char*)memchr(end, '\n', data + data_size - end);
+                end = nl ? nl + 1 : data + data_size;
             }
+            ChunkJob_t job;
+            job.reader = this;
+            job.begin = begin;
+            job.end = end;
+            job.line_num = 0;
+            job.theta_num = 0;
+            job.dense.set_dim(_dense.dim());
+            jobs.push_back(job);
+            begin = end;
+        }
 
-        } else if (_feature_mode == TFM_Values) {
-            CompactInstance_t compact_item(_theta_num);
-            size_t s = compact_item.parse_item(line, " ");
-            if (_theta_num==0) {
-                _theta_num = s;
-                LOG_NOTICE("ModeValues : read first line and get theta_num = %d", _theta_num);
+        Timer timer;
+        timer.begin();
+        ThreadPool_t pool(_thread_num);
+        if (_streaming) {
+            pool.run_jobs(_count_chunk, &jobs[0], jobs.size());
+        }
+        pool.run_jobs(_parse_chunk, &jobs[0], jobs.size());
+
+        // rows keep the order of lines.
+        size_t row_num = 0;
+        for (size_t i=0; i<jobs.size(); ++i) {
+            if (!_streaming) {
+                _rows.append(jobs[i].rows);
+                _dense.append(jobs[i].dense);
+                jobs[i].rows.clear();
+                jobs[i].dense.clear();
             }
-            _compact_buffer.push_back(compact_item);
+            row_num += jobs[i].line_num;
         }
+        for (size_t i=0; i<jobs.size(); ++i) {
+            if (jobs[i].error.length() > 0) {
+                if (stream_data.size() == 0) {
+                    munmap((void*)data, data_size);
+                }
+                throw std::runtime_error(jobs[i].error);
+            }
+            if (jobs[i].theta_num > _theta_num) {
+                _theta_num = jobs[i].theta_num;
+            }
+        }
+        timer.end();
+        LOG_NOTICE("parse %llu chunk(s) by %llu thread(s) : %.3fs", 
+                (unsigned long long)jobs.size(), (unsigned long long)_thread_num, timer.cost_time());
+
+        if (_streaming) {
+            // keep the mapping, read() parses lines from it.
+            _data = data;
+            _data_size = data_size;
+            _pos = 0;
+            madvise((void*)_data, _data_size, MADV_SEQUENTIAL);
+            if (_feature_mode == TFM_IndValue || _feature_mode == TFM_Values) {
+                _size = row_num;
+            }
+            _stream_compact.set_dim(_theta_num);
+        } else if (stream_data.size() == 0) {
+            munmap((void*)data, data_size);
+        }
+        LOG_NOTICE("record_num=%d, dim=%d", row_num, _theta_num);
+    } else {
+        LOG_NOTICE("record_num=0, dim=0");
+    }
+}
 
-        c++;
-        size_t process_size = ftell(_stream);
-        int cur_per = int(process_size * 100.0f / total_file_size);
-        if (cur_per > percentage) {
-            percentage = cur_per;
-            fprintf(stderr, "%cLoading complete %d%% (%d/%d kb)", 
-                    13, percentage, process_size/1024, total_file_size/1024);
-            fflush(stderr);
+void* 
+TextReader_t::_count_chunk(void* c) {
+    ChunkJob_t& job = *(ChunkJob_t*)c;
+    const char* p = job.begin;
+    while (p < job.end) {
+        const char* nl = (const char*)memchr(p, '\n', job.end - p);
+        job.line_num ++;
+        if (nl == NULL) {
+            break;
         }
+        p = nl + 1;
     }
-    fprintf(stderr, "\n");
-    LOG_NOTICE("record_num=%d, dim=%d", c, _theta_num);
-    fclose(_stream);
-    _stream = NULL;
+    return NULL;
+}
+
+void* 
+TextReader_t::_parse_chunk(void* c) {
+    ChunkJob_t& job = *(ChunkJob_t*)c;
+    TextReader_t& reader = *job.reader;
+    vector<char> line;
+    Instance_t item;
+    CompactInstance_t compact_item;
+    const char* p = job.begin;
+    try {
+        while (p < job.end) {
+            const char* nl = (const char*)memchr(p, '\n', job.end - p);
+            const char* text = p;
+            if (nl == NULL) {
+                // parsers stop at '\n' or '\0', the last line may have neither.
+                line.assign(p, job.end);
+                line.push_back(0);
+                text = &line[0];
+            }
+
+            if (reader._streaming) {
+                if (reader._feature_mode == TFM_IndValue) {
+                    int idx = __max_feature_index(text);
+                    if (idx >= job.theta_num) {
+                        job.theta_num = idx + 1;
+                    }
+                } else if (reader._feature_mode == TFM_Values) {
+                    // bad lines are found here instead of in read().
+                    if (compact_item.dim == 0) {
+                        compact_item.set_dim(reader._theta_num);
+                    }
+                    compact_item.parse_item(text, " ");
+                }
+            } else if (reader._feature_mode == TFM_IndValue) {
+                item.parse_item(text);
+                for (size_t i=0; i<item.features.size(); ++i) {   
+                    int idx = item.features[i].index;
+                    if (idx >= job.theta_num) {
+                        job.theta_num = idx + 1;
+                    }
+                }
+                job.rows.push_back(item);
+            } else if (reader._feature_mode == TFM_Values) {
+                if (compact_item.dim == 0) {
+                    compact_item.set_dim(reader._theta_num);
+                }
+                compact_item.parse_item(text, " ");
+                job.dense.push_back(compact_item.label, compact_item.values);
+            }
+            if (!reader._streaming) {
+                job.line_num ++;
+            }
+
+            if (nl == NULL) {
+                break;
+            }
+            p = nl + 1;
+        }
+    } catch (const std::exception& e) {
+        job.error = e.what();
+    }
+    return NULL;
 }
 
 void 
 TextReader_t::reset() {
     //fseek(_stream, 0, SEEK_SET);
     _cur_id = 0;
+    _pos = 0;
 }
 
 int 
 TextReader_t::percentage() const { 
-    if (__use_buffer()) {
-        return int(_cur_id * 100.0f / _buffer.size()); 
-    } else {
-         return int(_cur_id * 100.0f / _compact_buffer.size()); 
-    }
+    return int(_cur_id * 100.0f / size());
 }
 
 size_t 
 TextReader_t::size() const { 
-    if (__use_buffer()) {
-        return _buffer.size(); 
-    } else {
-        return _compact_buffer.size();
+    if (_streaming) {
+        return _size;
+    }
+    if (_feature_mode == TFM_Values) {
+        return _dense.size();
     }
+    return _rows.size();
 }
 
 bool 
 TextReader_t::read(Instance_t* item) {
-    if (__use_buffer()) {
-        if (_cur_id >= _buffer.size()) {
-            // read none.
+    if (_streaming) {
+        return _read_stream(item);
+    }
+    if (_feature_mode == TFM_Values) {
+        // for models without dense path.
+        if (_cur_id >= _dense.size()) {
             return false;
         }
+        _dense.get(_cur_id ++, item);
+        return true;
+    }
+    if (_cur_id >= _rows.size()) {
+        // read none.
+        return false;
+    }
+    _rows.get(_cur_id ++, item);
+    return true;
+}
 
-        *item = _buffer[_cur_id ++];
+bool 
+TextReader_t::read_view(InstanceView_t* view) {
+    if (_streaming || _feature_mode == TFM_Values) {
+        return IReader_t::read_view(view);
+    }
+    if (_cur_id >= _rows.size()) {
+        return false;
+    }
+    _rows.get_view(_cur_id ++, view);
+    return true;
+}
+
+bool 
+TextReader_t::_read_stream(Instance_t* item) {
+    if (_cur_id >= _size || _pos >= _data_size) {
+        return false;
+    }
+    const char* p = _data + _pos;
+    const char* nl = (const char*)memchr(p, '\n', _data_size - _pos);
+    const char* text = p;
+    if (nl == NULL) {
+        _line.assign(p, _data + _data_size);
+        _line.push_back(0);
+        text = &_line[0];
+        _pos = _data_size;
     } else {
-        if (_cur_id >= _compact_buffer.size()) {
-            // read none.
-            return false;
-        }
+        _pos = nl + 1 - _data;
+    }
 
-        _compact_buffer[_cur_id ++].convert_to_instance(item);
+    if (_feature_mode == TFM_IndValue) {
+        item->parse_item(text);
+    } else {
+        _stream_compact.parse_item(text, " ");
+        _stream_compact.convert_to_instance(item);
     }
+    _cur_id ++;
     return true;
 }
 
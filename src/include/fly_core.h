@@ -29,6 +29,17 @@ typedef hash_map<int, float> ParamDict_t;
 class FlyModel_t {
     public:
         virtual float predict(const Instance_t& ins) const = 0;
+        /*
+         * score the first n rows of batch into out[0, n).
+         *  models may override it to score many rows at once.
+         */
+        virtual void  predict_batch(const InstanceBatch_t& rows, size_t n, float* out) const {
+            Instance_t item;
+            for (size_t i=0; i<n; ++i) {
+                rows.get(i, &item);
+                out[i] = predict(item);
+            }
+        }
         virtual void  write_model(FILE* stream) const = 0;
         virtual void  read_model(FILE* stream) = 0;
         virtual void  init(IReader_t* reader) = 0;
@@ -58,6 +69,9 @@ class BinaryFileIO_t {
 
             Instance_t new_item;
             CompactInstance_t compact_item(0);
+            vector<uint64_t> offsets;
+            FileMeta_t meta;
+            meta.write_header(output_stream);
 
             // load all data into memory.
             while (fgets(_line_buffer, sizeof(_line_buffer), stream)) {
@@ -81,7 +95,8 @@ class BinaryFileIO_t {
                     }
                     compact_item.convert_to_instance(&new_item);
                 }
-                new_item.write_binary(output_stream);
+                offsets.push_back(new_item.write_binary(output_stream));
+                meta.update(new_item);
 
                 size_t process_size = ftell(stream);
                 int cur_per = int(process_size * 100.0f / total_file_size);
@@ -94,8 +109,13 @@ class BinaryFileIO_t {
             }
             fprintf(stderr, "\n");
 
+            meta.finish(output_stream);
+            size_t data_size = ftell(output_stream);
             fclose(output_stream);
             fclose(stream);
+
+            // sidecar index makes BinaryReader_t skip the stat pass.
+            BinaryReader_t::write_index(output_file, offsets, meta.dim(), data_size);
         }
 
     private:
@@ -50,51 +50,56 @@ struct Instance_t {
         fprintf(stream, "\n");
     }
 
-    bool parse_item(char *line) {
+    /*
+     * parse "label index:value ..." till '\0' or '\n'.
+     * tokens without ':' are skipped.
+     */
+    bool parse_item(const char *line) {
         if (*line == 0) {
             return false;
         }
 
-        char* end_ptr;
-        label = strtod(line, &end_ptr);
-        if (end_ptr == line) {
-            LOG_ERROR("parse_item() failed: label_parse: [%s]", end_ptr);
+        double d;
+        const char* p = parse_double(line, &d);
+        if (p == line) {
+            LOG_ERROR("parse_item() failed: label_parse: [%.64s]", line);
             return false;
         }
+        label = d;
         features.clear();
 
-        size_t begin = 0;
         IndValue_t iv;
-        iv.index = -1;
-        bool index_illegal = false;
-        for (size_t i=0; line[i]; ++i) {
-            if (line[i] == ':') {
-                iv.index = strtol(line + begin, &end_ptr, 10);
-                if (end_ptr == line+begin) {
-                    LOG_ERROR("parse_item() failed: index_parse: [%s]", line+begin);
-                    return false;
-                }
+        while (1) {
+            while (*p==' ' || *p=='\t' || *p=='\r') {
+                ++p;
+            }
+            if (*p==0 || *p=='\n') {
+                break;
+            }
 
-                begin = i+1;
-                index_illegal = true;
+            const char* colon = p;
+            while (*colon && *colon!=':' && *colon!=' ' && *colon!='\t' 
+                    && *colon!='\n' && *colon!='\r') 
+            {
+                ++colon;
+            }
+            if (*colon != ':') {
+                p = colon;
+                continue;
             }
-            if (line[i] == ' ' || line[i] == '\t' || line[i]=='\n' || line[i]=='\r') {
-                if (!index_illegal) {
-                    begin = i + 1;
-                    continue;
-                }
-                iv.value = strtod(line + begin, &end_ptr);
-                if (end_ptr == line+begin || (end_ptr!=NULL && *end_ptr!=' ' && *end_ptr!='\n' && *end_ptr!='\t' && *end_ptr!='\r')) {
-                    LOG_ERROR("parse_item() failed: value_parse: index=%d [%s]", iv.index, line+begin);
-                    return false;
-                }
 
-                //LOG_NOTICE("%d:%f", iv.index, iv.value);
-                features.push_back(iv);
-                iv.index = -1;
-                index_illegal = false;
-                begin = i + 1;
+            if (parse_int(p, &iv.index) == p) {
+                LOG_ERROR("parse_item() failed: index_parse: [%.64s]", p);
+                return false;
+            }
+            const char* value_begin = colon + 1;
+            p = parse_double(value_begin, &d);
+            if (p == value_begin || (*p!=' ' && *p!='\t' && *p!='\n' && *p!='\r' && *p!=0)) {
+                LOG_ERROR("parse_item() failed: value_parse: index=%d [%.64s]", iv.index, value_begin);
+                return false;
             }
+            iv.value = d;
+            features.push_back(iv);
         }
         return true;
     }
@@ -117,6 +122,219 @@ struct Instance_t {
     }
 };
 
+/*
+ * read-only view of an instance kept in other memory.
+ * (a mapped binary file for example.)
+ */
+struct InstanceView_t {
+    float label;
+    size_t feature_num;
+    const IndValue_t* features;
+
+    void copy_to(Instance_t* out) const {
+        out->label = label;
+        out->features.clear();
+        out->features.append(features, feature_num);
+    }
+};
+
+/*
+ * rows in compressed sparse row format:
+ *      row i owns features [_offsets[i], _offsets[i+1]).
+ *  all rows share three arrays, no malloc for each row,
+ *  and rows are read as views without copy.
+ */
+class CSRDataset_t {
+    public:
+        CSRDataset_t(size_t row_extend=1024):
+            _labels(row_extend),
+            _offsets(row_extend + 1),
+            _features(row_extend * 32)
+        {
+            _offsets.push_back(0);
+        }
+
+        size_t size() const { return _labels.size(); }
+        size_t total_feature_num() const { return _features.size(); }
+
+        void clear() {
+            _labels.clear();
+            _offsets.clear();
+            _features.clear();
+            _offsets.push_back(0);
+        }
+
+        void push_back(float label, const IndValue_t* features, size_t n) {
+            _labels.append(&label, 1);
+            _features.append(features, n);
+            size_t end = _features.size();
+            _offsets.append(&end, 1);
+        }
+
+        void push_back(const Instance_t& ins) {
+            push_back(ins.label, ins.features.buffer(), ins.features.size());
+        }
+
+        // append all rows of o.
+        void append(const CSRDataset_t& o) {
+            size_t base = _features.size();
+            size_t first = _offsets.size();
+            _labels.append(o._labels.buffer(), o._labels.size());
+            _features.append(o._features.buffer(), o._features.size());
+            _offsets.append(o._offsets.buffer() + 1, o.size());
+            size_t* offsets = _offsets.buffer();
+            for (size_t i=first; i<_offsets.size(); ++i) {
+                offsets[i] += base;
+            }
+        }
+
+        float label(size_t i) const { return _labels[i]; }
+        size_t feature_num(size_t i) const { return _offsets[i+1] - _offsets[i]; }
+        const IndValue_t* features(size_t i) const { 
+            return _features.buffer() + _offsets[i]; 
+        }
+
+        void get_view(size_t i, InstanceView_t* view) const {
+            view->label = _labels[i];
+            view->feature_num = feature_num(i);
+            view->features = features(i);
+        }
+
+        // copy row i into a reused instance.
+        void get(size_t i, Instance_t* out) const {
+            out->label = _labels[i];
+            out->features.clear();
+            out->features.append(features(i), feature_num(i));
+        }
+
+    private:
+        FArray_t<float>         _labels;
+        FArray_t<size_t>        _offsets;
+        FArray_t<IndValue_t>    _features;
+};
+
+/*
+ * dense rows of dim floats, one matrix in row-major order.
+ *  column-major copy is built by build_columns() for column scans,
+ *  it is dropped when rows are changed.
+ */
+class DenseDataset_t {
+    public:
+        DenseDataset_t(size_t dim=0, size_t row_extend=1024):
+            _dim(dim),
+            _labels(row_extend),
+            _values(row_extend * (dim>0 ? dim : 1)),
+            _has_columns(false)
+        {}
+
+        size_t size() const { return _labels.size(); }
+        size_t dim() const { return _dim; }
+
+        // dim can only be changed on empty dataset.
+        void set_dim(size_t dim) {
+            if (size() > 0 && dim != _dim) {
+                throw std::runtime_error("DenseDataset_t: set_dim() on non-empty dataset.");
+            }
+            _dim = dim;
+        }
+
+        void clear() {
+            _labels.clear();
+            _values.clear();
+            _columns.clear();
+            _has_columns = false;
+        }
+
+        void push_back(float label, const float* values) {
+            _labels.append(&label, 1);
+            _values.append(values, _dim);
+            _has_columns = false;
+        }
+
+        // append all rows of o, dims must be the same.
+        void append(const DenseDataset_t& o) {
+            if (o.size() == 0) {
+                return ;
+            }
+            if (o._dim != _dim) {
+                throw std::runtime_error("DenseDataset_t: append() with different dim.");
+            }
+            _labels.append(o._labels.buffer(), o._labels.size());
+            _values.append(o._values.buffer(), o._values.size());
+            _has_columns = false;
+        }
+
+        float label(size_t i) const { return _labels[i]; }
+        const float* labels() const { return _labels.buffer(); }
+        const float* row(size_t i) const { return _values.buffer() + i * _dim; }
+        float* mutable_row(size_t i) { 
+            _has_columns = false;
+            return _values.buffer() + i * _dim; 
+        }
+
+        /*
+         * transpose rows to column-major matrix.
+         * not thread-safe, call it once before column().
+         */
+        void build_columns() const {
+            if (_has_columns) {
+                return ;
+            }
+            size_t n = size();
+            _columns.resize(n * _dim);
+            float* cols = _columns.buffer();
+            const float* rows = _values.buffer();
+            // blocks of rows keep both matrices in cache.
+            static const size_t Block = 64;
+            for (size_t b=0; b<n; b+=Block) {
+                size_t e = min(n, b + Block);
+                for (size_t fid=0; fid<_dim; ++fid) {
+                    float* col = cols + fid * n;
+                    for (size_t i=b; i<e; ++i) {
+                        col[i] = rows[i * _dim + fid];
+                    }
+                }
+            }
+            _has_columns = true;
+        }
+
+        bool has_columns() const { return _has_columns; }
+
+        // free column-major copy when column scans are over.
+        void drop_columns() const {
+            _columns = FArray_t<float>();
+            _has_columns = false;
+        }
+
+        // values of feature fid for all rows, needs build_columns().
+        const float* column(size_t fid) const {
+            if (!_has_columns) {
+                throw std::runtime_error("DenseDataset_t: column() before build_columns().");
+            }
+            return _columns.buffer() + fid * size();
+        }
+
+        // copy row i as index:value pairs, zeros included.
+        void get(size_t i, Instance_t* out) const {
+            const float* values = row(i);
+            out->label = _labels[i];
+            out->features.resize(_dim);
+            IndValue_t* f = out->features.buffer();
+            for (size_t fid=0; fid<_dim; ++fid) {
+                f[fid].index = fid;
+                f[fid].value = values[fid];
+            }
+        }
+
+    private:
+        size_t              _dim;
+        FArray_t<float>     _labels;
+        FArray_t<float>     _values;
+        // cache of rows, built on demand.
+        mutable FArray_t<float> _columns;
+        mutable bool            _has_columns;
+};
+
 /*
  * compact-feature instance.
  * values is feature buffer. and dim info is not maintained in structure.
@@ -199,32 +417,76 @@ struct CompactInstance_t {
         }
     }
 
-    size_t parse_item(char* line, const char* sep=" ") {
+    /*
+     * parse "label value0 value1 ..." till '\0' or '\n'.
+     * fields are split by any char in sep, like strtok.
+     */
+    size_t parse_item(const char* line, const char* sep=" ") {
         if (*line == 0) {
             return 0;
         }
-        vector<string> flds;
-        split(line, sep, flds);
+        bool is_sep[256];
+        memset(is_sep, 0, sizeof(is_sep));
+        for (const char* s=sep; *s; ++s) {
+            is_sep[(unsigned char)*s] = true;
+        }
+
+        size_t field_num = 0;
+        const char* p = line;
+        while (1) {
+            while (is_sep[(unsigned char)*p]) {
+                ++p;
+            }
+            if (*p==0 || *p=='\n') {
+                break;
+            }
+            field_num ++;
+            while (*p && *p!='\n' && !is_sep[(unsigned char)*p]) {
+                ++p;
+            }
+        }
+        if (field_num == 0) {
+            return 0;
+        }
 
-        char* end_ptr;
-        float f = strtod(flds[0].c_str(), &end_ptr);
-        label = int(f+0.5);
-        size_t d = flds.size()-1;
+        size_t d = field_num - 1;
         if (dim>0 && d!=dim) {
             throw std::runtime_error("CompactValue parse failed! values not match in one line.");
         }
         if (values == NULL) {
             set_dim(d);
         }
-        for (size_t i=1; i<flds.size(); ++i) {
-            size_t ind = i-1;
-            values[ind] = strtod(flds[i].c_str(), &end_ptr);
+        p = line;
+        for (size_t i=0; i<field_num; ++i) {
+            while (is_sep[(unsigned char)*p]) {
+                ++p;
+            }
+            double v = 0;
+            parse_double(p, &v);
+            if (i == 0) {
+                label = int(float(v)+0.5);
+            } else {
+                values[i-1] = v;
+            }
+            while (*p && *p!='\n' && !is_sep[(unsigned char)*p]) {
+                ++p;
+            }
         }
         return dim;
     }
 };
 
 
+/*
+ * statistics of one feature over present (index, value) pairs.
+ */
+struct FeatureStat_t {
+    float       min;
+    float       max;
+    uint64_t    count;
+    uint64_t    nonzero;
+};
+
 /*
  * Interface of feature file reader.
  */
@@ -250,8 +512,246 @@ class IReader_t {
          *      }
          */ 
         virtual bool read(Instance_t* item) = 0;
+
+        /*
+         * read next instance as a view, without copy if reader keeps rows
+         * in memory. view is valid until next read or reset.
+         */
+        virtual bool read_view(InstanceView_t* view) {
+            if (!read(&_view_item)) {
+                return false;
+            }
+            view->label = _view_item.label;
+            view->feature_num = _view_item.features.size();
+            view->features = _view_item.features.buffer();
+            return true;
+        }
+
+        /*
+         * per-feature stats[dim()] if reader knows them without a pass.
+         * NULL otherwise.
+         */
+        virtual const FeatureStat_t* feature_stats() const { return NULL; }
+
+        /*
+         * all rows as dense matrix if reader keeps them so, NULL otherwise.
+         * models may train on it directly instead of read().
+         */
+        virtual const DenseDataset_t* dense_data() const { return NULL; }
+
+    private:
+        Instance_t  _view_item;
 };
 
+/*
+ * block of instances handed from reader to workers at once.
+ *  instances are kept in one CSRDataset_t, buffers are kept after 
+ *  clear(), so a reused batch does not malloc.
+ */
+class InstanceBatch_t {
+    public:
+        static const size_t DefaultCapacity = 1024;
+
+        InstanceBatch_t(size_t capacity=DefaultCapacity):
+            _capacity(capacity),
+            _rows(capacity)
+        {}
+
+        size_t size() const { return _rows.size(); }
+        size_t capacity() const { return _capacity; }
+        bool full() const { return _rows.size() >= _capacity; }
+
+        void clear() { _rows.clear(); }
+
+        void push_back(const Instance_t& ins) {
+            _rows.push_back(ins);
+        }
+
+        /*
+         * clear and read at most capacity() instances.
+         * return instance count read.
+         */
+        size_t fill(IReader_t* reader) {
+            clear();
+            InstanceView_t view;
+            while (!full() && reader->read_view(&view)) {
+                _rows.push_back(view.label, view.features, view.feature_num);
+            }
+            return size();
+        }
+
+        float label(size_t i) const { return _rows.label(i); }
+        size_t feature_num(size_t i) const { return _rows.feature_num(i); }
+        const IndValue_t* features(size_t i) const { return _rows.features(i); }
+
+        // copy instance i into a reused instance.
+        void get(size_t i, Instance_t* out) const {
+            _rows.get(i, out);
+        }
+
+    private:
+        size_t          _capacity;
+        CSRDataset_t    _rows;
+};
+
+/*
+ * meta of binary feature file. layout:
+ *      [Header_t] [records] [FeatureStat_t * dim]
+ *  stats follow the records so transform can write file in one pass,
+ *  header is written as a placeholder first and rewritten by finish().
+ *  files without header (older ones or temp files) are still readable.
+ */
+class FileMeta_t {
+    public:
+        static const uint32_t HeaderMagic = 0x7FF1F1B0; // NaN as float, never a label.
+        static const uint32_t Version = 1;
+
+        struct Header_t {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t record_num;
+            uint64_t dim;
+            uint64_t data_begin;    // offset of first record.
+            uint64_t data_end;      // offset after last record.
+        };
+
+        FileMeta_t() {
+            clear();
+        }
+
+        void clear() {
+            memset(&_header, 0, sizeof(_header));
+            _header.magic = HeaderMagic;
+            _header.version = Version;
+            _header.data_begin = sizeof(_header);
+            _header.data_end = sizeof(_header);
+            _stats.clear();
+        }
+
+        size_t record_num() const { return _header.record_num; }
+        size_t dim() const { return _header.dim; }
+        size_t data_begin() const { return _header.data_begin; }
+        size_t data_end() const { return _header.data_end; }
+        const FeatureStat_t* stats() const { 
+            return _stats.size()>0 ? &_stats[0] : NULL; 
+        }
+
+        void update(const Instance_t& ins) {
+            _header.record_num ++;
+            for (size_t i=0; i<ins.features.size(); ++i) {
+                const IndValue_t& iv = ins.features[i];
+                if (iv.index < 0) {
+                    continue;
+                }
+                if ((size_t)iv.index >= _stats.size()) {
+                    FeatureStat_t empty;
+                    memset(&empty, 0, sizeof(empty));
+                    _stats.resize(iv.index + 1, empty);
+                    _header.dim = _stats.size();
+                }
+                FeatureStat_t& st = _stats[iv.index];
+                if (st.count == 0 || iv.value < st.min) {
+                    st.min = iv.value;
+                }
+                if (st.count == 0 || iv.value > st.max) {
+                    st.max = iv.value;
+                }
+                st.count ++;
+                if (iv.value != 0) {
+                    st.nonzero ++;
+                }
+            }
+        }
+
+        void write_header(FILE* stream) const {
+            fwrite(&_header, sizeof(_header), 1, stream);
+        }
+
+        /*
+         * call after last record written.
+         * write stats and rewrite header.
+         */
+        void finish(FILE* stream) {
+            _header.data_end = ftell(stream);
+            _header.dim = _stats.size();
+            if (_stats.size() > 0) {
+                fwrite(&_stats[0], sizeof(FeatureStat_t), _stats.size(), stream);
+            }
+            size_t end = ftell(stream);
+            fseek(stream, 0, SEEK_SET);
+            write_header(stream);
+            fseek(stream, end, SEEK_SET);
+        }
+
+        /*
+         * parse header only. (for streaming input)
+         * return false if buffer is not a header.
+         */
+        bool parse_header(const char* buffer, size_t size) {
+            clear();
+            if (size < sizeof(Header_t)) {
+                return false;
+            }
+            Header_t header;
+            memcpy(&header, buffer, sizeof(header));
+            if (header.magic != HeaderMagic) {
+                return false;
+            }
+            if (header.version != Version) {
+                LOG_ERROR("binary file version %u is not supported.", header.version);
+                throw std::runtime_error("Unsupported binary file version.");
+            }
+            if (header.data_begin < sizeof(header) || header.data_end < header.data_begin) {
+                throw std::runtime_error("Broken binary file header.");
+            }
+            _header = header;
+            return true;
+        }
+
+        /*
+         * parse header and stats from a whole mapped file.
+         * return false if file has no header.
+         */
+        bool parse(const char* data, size_t size) {
+            if (!parse_header(data, size)) {
+                return false;
+            }
+            if (_header.data_end > size 
+                    || _header.dim > (size - _header.data_end) / sizeof(FeatureStat_t)) {
+                throw std::runtime_error("Broken binary file header.");
+            }
+            _stats.resize(_header.dim);
+            if (_header.dim > 0) {
+                memcpy(&_stats[0], data + _header.data_end, sizeof(FeatureStat_t) * _header.dim);
+            }
+            return true;
+        }
+
+    private:
+        Header_t                _header;
+        vector<FeatureStat_t>   _stats;
+};
+
+/*
+ * sidecar row-offset index of a binary file, kept in <binary_file>.idx
+ *  BinaryIndexHeader_t, then uint64_t offsets[record_num].
+ */
+struct BinaryIndexHeader_t {
+    static const uint32_t Magic = 0x58444946; // "FIDX"
+    static const uint32_t Version = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint64_t record_num;
+    uint64_t dim;
+    uint64_t data_size; // size of binary file, to detect a stale index.
+};
+
+/*
+ * binary file reader.
+ *  regular files are mapped and records are parsed in place.
+ *  /dev/stdin is read as a stream.
+ */
 class BinaryReader_t 
     : public IReader_t
 {
@@ -266,13 +766,55 @@ class BinaryReader_t
         void stat();
         virtual void reset();
         virtual bool read(Instance_t* item);
+        virtual const FeatureStat_t* feature_stats() const { 
+            return _has_meta ? _meta.stats() : NULL; 
+        }
+
+        /*
+         * read next record as a view into the mapped file.
+         * view keeps valid until reader is set to another file or destroyed.
+         */
+        virtual bool read_view(InstanceView_t* view);
+
+        /*
+         * random access.
+         */
+        void get_view(size_t row_id, InstanceView_t* view);
+
+        /*
+         * write the offset index of a binary file.
+         */
+        static void write_index(const char* filename, 
+                const vector<uint64_t>& offsets, size_t dim, size_t data_size);
 
     private:
-        FILE*   _stream;
+        FILE*   _stream;    // only for streaming input.
         size_t  _cur_id;
         size_t  _size;  // total record num.
         int     _theta_num;
         bool    _is_stat;
+
+        FileMeta_t  _meta;
+        bool        _has_meta;
+        bool        _label_pending; // label of first record is read with magic.
+        float       _pending_label;
+
+        const char* _data;
+        size_t      _data_size;
+        size_t      _data_begin;
+        size_t      _data_end;
+        size_t      _pos;
+
+        void*           _index_map;
+        size_t          _index_map_size;
+        const uint64_t* _offsets;
+        vector<uint64_t>    _offset_buffer;
+
+        void _close();
+        void _scan();
+        void _open_stream(const char* filename);
+        bool _load_index(const char* filename);
+        bool _parse(size_t pos, InstanceView_t* view, size_t* next_pos) const;
 };
 
 /**
@@ -305,33 +847,77 @@ class TextReader_t
             _feature_mode = mode;
         }
 
+        /*
+         * streaming: set() only counts rows and dim, and read() parses lines
+         *  from the mapped file, so memory does not grow with file size.
+         *  needs a regular file. call it before set().
+         */
+        void set_streaming(bool streaming) {
+            _streaming = streaming;
+        }
+
+        /*
+         * threads to parse file in set(). default is cpu count.
+         */
+        void set_thread_num(size_t thread_num) {
+            _thread_num = (thread_num>0) ? thread_num : 1;
+        }
+
         virtual void set(const char* filename);
         virtual void reset();
         virtual bool read(Instance_t* item);
+        virtual bool read_view(InstanceView_t* view);
+
+        /*
+         * random access of ind-value rows, not for streaming.
+         * value-buffer rows are in dense_data().
+         */
+        void get_view(size_t row_id, InstanceView_t* view) const {
+            _rows.get_view(row_id, view);
+        }
+
+        virtual const DenseDataset_t* dense_data() const {
+            if (_streaming || _feature_mode != TFM_Values) {
+                return NULL;
+            }
+            return &_dense;
+        }
 
         static TextFeatureMode_t auto_detect_mode(const char* line);
 
     private:
         static const size_t MaxLineLength = 40960;
 
+        struct ChunkJob_t;
+
         FILE*   _stream;
         size_t  _roll_size;
         size_t  _cur_id;
+        size_t  _thread_num;
 
         int     _theta_num;
 
         /*
-         * Two types of instance.
-         *  1. ind-value. (Instance_t)
-         *  2. value-buffer. (CompactInstance_t)
+         * rows of ind-value file are kept in _rows,
+         * rows of value-buffer file are kept in _dense.
          */
-        TextFeatureMode_t    _feature_mode;
-        FArray_t<Instance_t> _buffer;
-        FArray_t<CompactInstance_t> _compact_buffer;
-
-        bool __use_buffer() const {
-            return _feature_mode != TFM_Values;
-        }
+        TextFeatureMode_t   _feature_mode;
+        CSRDataset_t        _rows;
+        DenseDataset_t      _dense;
+
+        // streaming mode.
+        bool        _streaming;
+        const char* _data;
+        size_t      _data_size;
+        size_t      _pos;
+        size_t      _size;
+        vector<char>        _line;
+        CompactInstance_t   _stream_compact;
+
+        void _unmap();
+        bool _read_stream(Instance_t* item);
+        static void* _count_chunk(void* c);
+        static void* _parse_chunk(void* c);
 
 };
 
@@ -348,111 +934,47 @@ enum BinaryFeatureType_t {
     BF_SparseBinary // {0, 1} and the amount of 1 is very little.
 };
 
-
-#if 0
-class FileMeta_t {
-    public:
-        void write(FILE* stream) const {
-            fwrite(&FileMeta_t::HeaderMagic, sizeof(FileMeta_t::HeaderMagic), 1, stream);
-            int lemma_num = _kv.size();
-            fwrite(&lemma_num, sizeof(lemma_num), stream);
-
-            for (map<string, string>::const_iterator iter = _kv.begin(); iter!=_kv.end(); ++iter) {
-                _write_str(stream, iter->first);
-                _write_str(stream, iter->second);
-            }
-        }
-
-        /*
-         * return true if reade meta ok.
-         */
-        bool read(FILE* stream) {
-            int header;
-            fread(&header, sizeof(header), 1, stream);
-            if (header == HeaderMagic) {
-                int lemma_num;
-                fread(&lemma_num, sizeof(lemma_num), 1, stream);
-                for (int i=0; i<lemma_num; ++i) {
-                    key = _read_str(stream);
-                    value = _read_str(stream);
-                    _kv[key] = value;
-                }
-                return true;
-            } else {
-                LOG_ERROR("Bad header for filemeta.");
-                return false;
-            }
-        }
-
-        bool get(const string& key, string& out_value) const {
-            if (_kv.find(key)!=_kv.end()) {
-                out_value = _kv[key];
-                return true;
-            }
-            return false;
-        }
-
-        void set(const string& key, const string& value) {
-            _kv[key] = value;
-        }
-
-    private:
-        const static int HeaderMagic = 0xDEADDEEF;
-        map<string, string> _kv;
-
-        string _read_str(FILE* stream) {
-            int sz;
-            fread(sz, sizeof(int), 1, stream);
-            char buf = new char[sz + 1];
-            fread(buf, 1, sz, stream);
-            string s(buf);
-            delete [] buf;
-            return s;
-        }
-
-        void _write_str(FILE* stream, const string& s) {
-            int sz = (int)s.length();
-            fwrite(sz, sizeof(int), 1, stream);
-            fwrite(s.c_str(), 1, s.length(), stream);
-        }
-};
-#endif
-
-
-#if 0
+/*
+ * reader over a dense dataset kept in memory.
+ *  read() gives index:value rows with zeros, 
+ *  models with dense path use dense_data() instead.
+ */
 class DenseReader_t:
-    IReader_t
+    public IReader_t
 {
     public:
-        virtual size_t size() const {
-        }
+        DenseReader_t(): _cur_id(0) {}
 
-        virtual size_t processed_num() const {
+        virtual size_t size() const { return _data.size(); }
+        virtual size_t processed_num() const { return _cur_id; }
+        virtual size_t dim() const { return _data.dim(); }
+        virtual int percentage() const {
+            return size()>0 ? int(_cur_id * 100.0f / size()) : 100;
         }
 
-        virtual size_t dim() const {
+        // rows are given by data(), no file to open.
+        virtual void set(const char* filename) {
+            throw std::runtime_error("DenseReader_t cannot set file.");
         }
 
-        virtual int percentage() const = 0;
-        virtual void set(const char* filename) {
+        virtual void reset() { _cur_id = 0; }
+
+        virtual bool read(Instance_t* item) {
+            if (_cur_id >= _data.size()) {
+                return false;
+            }
+            _data.get(_cur_id ++, item);
+            return true;
         }
 
-        /**
-         *  reset the stream.
-         */
-        virtual void reset() = 0;
+        virtual const DenseDataset_t* dense_data() const { return &_data; }
 
-        /**
-         *  usage:
-         *      TextReader_t r(stream);
-         *      Instance_t item;
-         *      while (reader.read(&item)) {
-         *          // do what you need to do.
-         *      }
-         */ 
-        virtual bool read(Instance_t* item) = 0;
+        DenseDataset_t& data() { return _data; }
+
+    private:
+        DenseDataset_t  _data;
+        size_t          _cur_id;
 };
-#endif
 
 #endif  //__FLY_DATA_H_
 
@@ -179,6 +179,15 @@ float sparse_dot(const Param_t& p, const FArray_t<IndValue_t>& input) {
     return ret;
 }
 
+float dense_dot(const Param_t& p, const float* values, size_t dim) {
+    float ret = p.b;
+    size_t n = min(dim, p.size());
+    for (size_t i=0; i<n; ++i) {
+        ret += p.w[i] * values[i];
+    }
+    return ret;
+}
+
 #endif  //__FLY_MATH_H_
 
 /* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -8,6 +8,8 @@
 #include <ctime>
 
 #include <vector>
+#include <deque>
+#include <algorithm>
 #include <string>
 #include <stdexcept>
 
@@ -17,6 +19,7 @@
 
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include <cstdlib>
 #include <cstring>
@@ -119,7 +122,9 @@ class FArray_t {
             _extend_num(extend_num)
         {}
 
-        FArray_t(const FArray_t& o) {
+        FArray_t(const FArray_t& o):
+            _l(NULL)
+        {
             _bnum = o._bnum;
             _num = o._num;
             _extend_num = o._extend_num;
@@ -158,6 +163,29 @@ class FArray_t {
 
         void clear() { _num = 0; }
 
+        void reserve(size_t n) {
+            if (n > _bnum) {
+                _reserve(n);
+            }
+        }
+
+        // set size to n, new items are default constructed.
+        void resize(size_t n) {
+            if (n > _bnum) {
+                _reserve(n);
+            }
+            _num = n;
+        }
+
+        // append n items by memcpy. buffer grows by doubling.
+        void append(const T* p, size_t n) {
+            if (_num + n > _bnum) {
+                _reserve(max(_num + n, max(_bnum * 2, _bnum + _extend_num)));
+            }
+            memcpy(_l + _num, p, n * sizeof(T));
+            _num += n;
+        }
+
         T& operator [] (size_t idx) {
             if (idx >= _num) {
                 throw std::runtime_error("index out of range.");
@@ -197,18 +225,22 @@ class FArray_t {
         size_t _bnum;
         size_t _extend_num;
 
-        void _extend() {
-            _l = (T*)realloc(_l, (_bnum + _extend_num) * sizeof(T) );
+        void _reserve(size_t n) {
+            _l = (T*)realloc(_l, n * sizeof(T) );
             //LOG_NOTICE("r: %p", _l);
             if (_l == NULL) {
                 throw std::runtime_error("extend buffer for FArray failed!");
             }
-            _bnum += _extend_num;
 
             // NOTICE! placement new.
-            for (size_t i=_num; i<_bnum; ++i) {
+            for (size_t i=_bnum; i<n; ++i) {
                 new(_l+i) T();
             }
+            _bnum = n;
+        }
+
+        void _extend() {
+            _reserve(_bnum + _extend_num);
         }
 
         void _release() {
@@ -231,6 +263,119 @@ inline void split(char* s, const char* token, std::vector<std::string>& out) {
     return ;
 }
 
+/*
+ * allocation-free number parsers, used for text features.
+ *  same result as strtol/strtod, return the end of number 
+ *  (or p if nothing parsed). only ' ' and '\t' are skipped before number,
+ *  so a parse never runs into the next line.
+ *  common decimals take the fast path, others go to strtol/strtod.
+ */
+inline const char* parse_int(const char* p, int* out) {
+    const char* s = p;
+    while (*s==' ' || *s=='\t') {
+        ++s;
+    }
+    bool neg = false;
+    if (*s=='-' || *s=='+') {
+        neg = (*s=='-');
+        ++s;
+    }
+    const char* digit_begin = s;
+    int64_t v = 0;
+    while (*s>='0' && *s<='9') {
+        v = v * 10 + (*s - '0');
+        ++s;
+    }
+    if (s == digit_begin) {
+        return p;
+    }
+    if (s - digit_begin > 18) {
+        char* end;
+        *out = strtol(p, &end, 10);
+        return end;
+    }
+    *out = (int)(neg ? -v : v);
+    return s;
+}
+
+inline const char* parse_double(const char* p, double* out) {
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char* s = p;
+    while (*s==' ' || *s=='\t') {
+        ++s;
+    }
+    bool neg = false;
+    if (*s=='-' || *s=='+') {
+        neg = (*s=='-');
+        ++s;
+    }
+
+    const char* num_begin = s;
+    uint64_t mant = 0;
+    int sig_digits = 0;
+    int exp10 = 0;
+    bool any_digit = false;
+    for (; *s>='0' && *s<='9'; ++s) {
+        any_digit = true;
+        if (mant>0 || *s!='0') {
+            mant = mant * 10 + (*s - '0');
+            sig_digits ++;
+        }
+    }
+    if (*s == '.') {
+        ++s;
+        for (; *s>='0' && *s<='9'; ++s) {
+            any_digit = true;
+            if (mant>0 || *s!='0') {
+                mant = mant * 10 + (*s - '0');
+                sig_digits ++;
+            }
+            exp10 --;
+        }
+    }
+    if (*s=='e' || *s=='E') {
+        const char* e = s + 1;
+        bool exp_neg = false;
+        if (*e=='-' || *e=='+') {
+            exp_neg = (*e=='-');
+            ++e;
+        }
+        if (*e>='0' && *e<='9') {
+            int x = 0;
+            for (; *e>='0' && *e<='9'; ++e) {
+                if (x < 10000) {
+                    x = x * 10 + (*e - '0');
+                }
+            }
+            exp10 += exp_neg ? -x : x;
+            s = e;
+        }
+    }
+
+    if (!any_digit) {
+        // only inf/nan are left to strtod.
+        if (*num_begin!='i' && *num_begin!='I' && *num_begin!='n' && *num_begin!='N') {
+            return p;
+        }
+    }
+
+    // exact only if mantissa and power of 10 are both exact doubles.
+    if (!any_digit || sig_digits > 19 || mant > (1ULL<<53) 
+            || exp10 < -22 || exp10 > 22 || *s=='x' || *s=='X') 
+    {
+        char* end;
+        *out = strtod(p, &end);
+        return end;
+    }
+    double v = (double)mant;
+    v = (exp10 < 0) ? v / pow10[-exp10] : v * pow10[exp10];
+    *out = neg ? -v : v;
+    return s;
+}
+
 class Lock_t {
     public:
         Lock_t() {
@@ -280,168 +425,668 @@ class ThreadData_t {
 };
 
 /*
- * Producer and Customer Poot
- * Condition: 
- *      _p_id + 1 != _c_id
- *      _c_id + 2 != _p_id (..)
- * one empty cell to make validation.
- *  * Single putter and multi-getter.
+ * Producer and Customer Pool.
+ *  bounded lock-free queue for multi-putter and multi-getter.
+ *  each cell has a sequence number:
+ *      seq == pos           : cell is free for putting at pos.
+ *      seq == pos + 1       : cell is filled at pos, ready for getting.
+ *  a position is claimed by CAS, the cell is handed over by release-store
+ *  of its sequence, so items are filled and consumed in place without lock.
+ *  threads spin for a short while on full/empty, then yield, then sleep.
+ *
+ *  usage(zero copy):
+ *      T* cell = pool.begin_put();  fill cell;  pool.end_put();
+ *      T* cell = pool.begin_get();  use cell;   pool.end_get(cell);
  */
 template <typename T>
 class PCPool_t {
     public:
         PCPool_t(size_t buffer_size) {
-            _buffer_size = buffer_size;
-            _buffer = new T[_buffer_size];
-            _c_id = 0;
+            _buffer_size = 2;
+            while (_buffer_size < buffer_size) {
+                _buffer_size <<= 1;
+            }
+            _mask = _buffer_size - 1;
+            _buffer = new Cell_t[_buffer_size];
+            for (size_t i=0; i<_buffer_size; ++i) {
+                _buffer[i].seq = i;
+            }
             _p_id = 0;
-            _total_get = 0;
-            _total_put = 0;
+            _c_id = 0;
             _flag_putting = true;
-            pthread_spin_init(&_spinlock, 0);
+            _put_waiters = 0;
+            _get_waiters = 0;
+            pthread_mutex_init(&_lock, 0);
+            pthread_cond_init(&_cond, 0);
         }
         ~PCPool_t() {
             if (_buffer) {
                 delete [] _buffer;
+                _buffer = NULL;
                 _buffer_size = 0;
             }
+            pthread_cond_destroy(&_cond);
+            pthread_mutex_destroy(&_lock);
         }
 
         // Producer put item.
         void put(const T& item) {
-            // try util ok.
-            while (1) {
-                size_t next_id = (_p_id + 1) % _buffer_size;
-                if (next_id == _c_id) {
-                    // full: need to wait for putting.
-                    continue;
-                }
-                _buffer[_p_id] = item;
-                _p_id = next_id;
-                _total_put += 1;
-                return ;
-            }
+            T* cell = begin_put();
+            *cell = item;
+            end_put(cell);
         }
 
         // Return ptr for writing object.
+        // wait until there is a free cell.
         T* begin_put() {
-            // try util ok.
+            size_t tries = 0;
             while (1) {
-                size_t next_id = (_p_id + 1) % _buffer_size;
-                if (next_id == _c_id) {
-                    // full: need to wait for putting.
-                    //LOG_NOTICE("full: %d,%d (%d)", _p_id, _c_id, _total_put);
-                    continue;
+                size_t pos = __atomic_load_n(&_p_id, __ATOMIC_RELAXED);
+                Cell_t* cell = _buffer + (pos & _mask);
+                size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+                intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+                if (dif == 0) {
+                    if (__atomic_compare_exchange_n(&_p_id, &pos, pos+1, true,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) 
+                    {
+                        cell->pos = pos;
+                        return &cell->data;
+                    }
+                } else if (dif < 0) {
+                    // full: need to wait for getting.
+                    _backoff(tries++, true);
                 }
-                return _buffer + _p_id;
             }
         }
 
-        void end_put(bool put_ok=true) {
-            if (put_ok) {
-                _p_id = (_p_id + 1) % _buffer_size;;
-                _total_put += 1;
-            }
+        // put_ok=false : cell is given back empty, getters will skip it.
+        void end_put(T* item, bool put_ok=true) {
+            Cell_t* cell = (Cell_t*)item;
+            cell->valid = put_ok;
+            __atomic_store_n(&cell->seq, cell->pos + 1, __ATOMIC_RELEASE);
+            _wake(&_get_waiters);
         }
 
         // Customer try to get.
-        // loop util get.
-        // return false if nothing to process forever.
-        bool get(T* out_item, uint32_t* out_order_id = NULL) {
-            // retry until work or full.
+        // wait until get one cell.
+        // return NULL if nothing to process forever.
+        T* begin_get(uint32_t* out_order_id = NULL) {
+            size_t tries = 0;
             while (1) {
-                pthread_spin_lock(&_spinlock);
-                if (_c_id == _p_id) { // empty or stop.
-                    pthread_spin_unlock(&_spinlock);
-                    // need to wait for processing.
-                    if (!_flag_putting) {
-                        //LOG_NOTICE("return false");
-                        return false;
+                size_t pos = __atomic_load_n(&_c_id, __ATOMIC_RELAXED);
+                Cell_t* cell = _buffer + (pos & _mask);
+                size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+                intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+                if (dif == 0) {
+                    if (__atomic_compare_exchange_n(&_c_id, &pos, pos+1, true,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) 
+                    {
+                        if (!cell->valid) {
+                            _release(cell);
+                            continue;
+                        }
+                        if (out_order_id) {
+                            *out_order_id = pos;
+                        }
+                        return &cell->data;
                     }
-                    continue;
-                }
-                if (_c_id + 1 == _p_id && _flag_putting) {
-                    pthread_spin_unlock(&_spinlock);
-                    // need to wait for processing.
-                    continue;
-                }
-                size_t m = _c_id;
-                //LOG_NOTICE("get: %d,%d (%d)", _p_id, _c_id, _total_put);
-                _c_id = (_c_id + 1) % _buffer_size;
-                if (out_order_id) {
-                    *out_order_id = _total_get;
+                } else if (dif < 0) {
+                    // empty or stop.
+                    if (!__atomic_load_n(&_flag_putting, __ATOMIC_ACQUIRE)) {
+                        // re-check: items may be put before stop.
+                        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+                        if (seq != pos + 1) {
+                            return NULL;
+                        }
+                        continue;
+                    }
+                    _backoff(tries++, false);
                 }
-                _total_get += 1;
-                *out_item = _buffer[m];
-                // unlock.
-                //LOG_NOTICE("return true: c_id=%d(%d):%p p_id=%d", m, _c_id, *out_item, _p_id);
-                pthread_spin_unlock(&_spinlock);
-                return true;
             }
         }
 
-        size_t num_get() const { return _total_get; }
-        size_t num_put() const { return _total_put; }
+        void end_get(T* item) {
+            _release((Cell_t*)item);
+        }
+
+        // copy the item out.
+        // return false if nothing to process forever.
+        bool get(T* out_item, uint32_t* out_order_id = NULL) {
+            T* cell = begin_get(out_order_id);
+            if (cell == NULL) {
+                return false;
+            }
+            *out_item = *cell;
+            end_get(cell);
+            return true;
+        }
+
+        size_t num_get() const { return _c_id; }
+        size_t num_put() const { return _p_id; }
 
         void set_putting(bool putting) {
-            _flag_putting = putting;
+            __atomic_store_n(&_flag_putting, putting, __ATOMIC_RELEASE);
+            pthread_mutex_lock(&_lock);
+            pthread_cond_broadcast(&_cond);
+            pthread_mutex_unlock(&_lock);
         }
 
     private:
-        T*      _buffer;
+        struct Cell_t {
+            T       data;   // must be the first member.
+            size_t  seq;
+            size_t  pos;
+            bool    valid;
+        };
+
+        Cell_t* _buffer;
         size_t  _buffer_size;
-        volatile size_t  _c_id;
-        volatile size_t  _p_id;
+        size_t  _mask;
+
+        // keep putter and getter positions on different cache lines.
+        char    _pad0[64];
+        size_t  _p_id;
+        char    _pad1[64];
+        size_t  _c_id;
+        char    _pad2[64];
+
         bool    _flag_putting;
+        int     _put_waiters;
+        int     _get_waiters;
+        pthread_mutex_t _lock;
+        pthread_cond_t  _cond;
 
-        size_t  _total_get;
-        size_t  _total_put;
+        void _release(Cell_t* cell) {
+            __atomic_store_n(&cell->seq, cell->pos + _buffer_size, __ATOMIC_RELEASE);
+            _wake(&_put_waiters);
+        }
+
+        void _wake(int* waiters) {
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(waiters, __ATOMIC_RELAXED) > 0) {
+                pthread_mutex_lock(&_lock);
+                pthread_cond_broadcast(&_cond);
+                pthread_mutex_unlock(&_lock);
+            }
+        }
 
-        pthread_spinlock_t _spinlock;
+        // spin -> yield -> sleep.
+        void _backoff(size_t tries, bool putter) {
+            if (tries < 64) {
+                __builtin_ia32_pause();
+                return ;
+            }
+            if (tries < 128) {
+                sched_yield();
+                return ;
+            }
+            int* waiters = putter ? &_put_waiters : &_get_waiters;
+            pthread_mutex_lock(&_lock);
+            __atomic_add_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+            if (!_ready(putter)) {
+                // timed: a lost signal costs at most 10ms.
+                timeval now;
+                gettimeofday(&now, NULL);
+                timespec ts;
+                ts.tv_sec = now.tv_sec;
+                ts.tv_nsec = now.tv_usec * 1000 + 10000000;
+                if (ts.tv_nsec >= 1000000000) {
+                    ts.tv_sec += 1;
+                    ts.tv_nsec -= 1000000000;
+                }
+                pthread_cond_timedwait(&_cond, &_lock, &ts);
+            }
+            __atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&_lock);
+        }
+
+        // whether the waiting side can go on.
+        bool _ready(bool putter) const {
+            if (putter) {
+                size_t pos = __atomic_load_n(&_p_id, __ATOMIC_SEQ_CST);
+                return __atomic_load_n(&_buffer[pos & _mask].seq, __ATOMIC_SEQ_CST) == pos;
+            }
+            if (!__atomic_load_n(&_flag_putting, __ATOMIC_SEQ_CST)) {
+                return true;
+            }
+            size_t pos = __atomic_load_n(&_c_id, __ATOMIC_SEQ_CST);
+            return __atomic_load_n(&_buffer[pos & _mask].seq, __ATOMIC_SEQ_CST) == pos + 1;
+        }
 };
 
+/*
+ * Fixed-size work-stealing thread pool.
+ *  threads are created once and each one owns a task deque.
+ *  run_jobs() spreads a group of jobs over the deques in contiguous blocks
+ *  and blocks until all of them are done.
+ *  a thread pops tasks from the front of its own deque, and when it is empty
+ *  steals from the back of the others, so one slow block of jobs does not
+ *  hold the rest of the pool idle. threads with nothing to do sleep on a
+ *  condition variable.
+ *  NOTICE: jobs must return instead of calling pthread_exit().
+ */
+class ThreadPool_t {
+    public:
+        ThreadPool_t(size_t thread_num):
+            _stop(false),
+            _task_count(0)
+        {
+            pthread_mutex_init(&_lock, 0);
+            pthread_cond_init(&_task_cond, 0);
+            pthread_cond_init(&_done_cond, 0);
+
+            _thread_num = (thread_num>0) ? thread_num : 1;
+            _workers = new Worker_t[_thread_num];
+            for (size_t i=0; i<_thread_num; ++i) {
+                _workers[i].pool = this;
+                _workers[i].id = i;
+                pthread_create(&_workers[i].tid, NULL, _worker, _workers+i);
+            }
+        }
 
+        ~ThreadPool_t() {
+            pthread_mutex_lock(&_lock);
+            _stop = true;
+            pthread_cond_broadcast(&_task_cond);
+            pthread_mutex_unlock(&_lock);
+            for (size_t i=0; i<_thread_num; ++i) {
+                pthread_join(_workers[i].tid, NULL);
+            }
+            delete [] _workers;
+
+            pthread_cond_destroy(&_done_cond);
+            pthread_cond_destroy(&_task_cond);
+            pthread_mutex_destroy(&_lock);
+        }
+
+        size_t size() const { return _thread_num; }
+
+        /*
+         * index of the pool thread running the caller in [0, size()),
+         * -1 if the caller is not a pool thread.
+         * jobs use it to pick per-thread scratch.
+         */
+        static int worker_index() { 
+            return _current_worker(); 
+        }
+
+        /*
+         * run func_t(job_context+i) for i in [0, job_num).
+         * at most size() jobs run at the same time, so jobs which wait
+         * for each other (reader and workers) need job_num<=size().
+         */
+        template<typename Job_t>
+        void run_jobs(void* (func_t)(void*), Job_t* job_context, size_t job_num) {
+            if (job_num == 0) {
+                return ;
+            }
+            volatile size_t pending = job_num;
+            for (size_t w=0; w<_thread_num; ++w) {
+                // neighbour jobs go to the same thread.
+                size_t b = job_num * w / _thread_num;
+                size_t e = job_num * (w+1) / _thread_num;
+                if (b == e) {
+                    continue;
+                }
+                Worker_t& worker = _workers[w];
+                worker.lock.lock();
+                for (size_t i=b; i<e; ++i) {
+                    Task_t task;
+                    task.func = func_t;
+                    task.arg = job_context + i;
+                    task.pending = &pending;
+                    worker.tasks.push_back(task);
+                }
+                worker.lock.unlock();
+            }
+            __sync_fetch_and_add(&_task_count, job_num);
+
+            pthread_mutex_lock(&_lock);
+            pthread_cond_broadcast(&_task_cond);
+            while (pending > 0) {
+                pthread_cond_wait(&_done_cond, &_lock);
+            }
+            pthread_mutex_unlock(&_lock);
+        }
+
+    private:
+        struct Task_t {
+            void* (*func)(void*);
+            void* arg;
+            volatile size_t* pending;   // jobs remain in the group of this task.
+        };
+
+        struct Worker_t {
+            ThreadPool_t*   pool;
+            size_t          id;
+            pthread_t       tid;
+            Lock_t          lock;
+            deque<Task_t>   tasks;
+        };
+
+        size_t          _thread_num;
+        Worker_t*       _workers;
+        bool            _stop;
+        volatile size_t _task_count;    // tasks in all deques.
+
+        pthread_mutex_t _lock;
+        pthread_cond_t  _task_cond;
+        pthread_cond_t  _done_cond;
+
+        bool _take(size_t id, Task_t* out) {
+            // own deque first, then steal from others.
+            for (size_t k=0; k<_thread_num; ++k) {
+                Worker_t& w = _workers[(id + k) % _thread_num];
+                w.lock.lock();
+                if (w.tasks.empty()) {
+                    w.lock.unlock();
+                    continue;
+                }
+                if (k == 0) {
+                    *out = w.tasks.front();
+                    w.tasks.pop_front();
+                } else {
+                    *out = w.tasks.back();
+                    w.tasks.pop_back();
+                }
+                w.lock.unlock();
+                __sync_fetch_and_sub(&_task_count, 1);
+                return true;
+            }
+            return false;
+        }
+
+        static int& _current_worker() {
+            static __thread int id = -1;
+            return id;
+        }
+
+        static void* _worker(void* c) {
+            Worker_t& me = *(Worker_t*)c;
+            ThreadPool_t& pool = *me.pool;
+            _current_worker() = (int)me.id;
+            while (1) {
+                Task_t task;
+                if (pool._take(me.id, &task)) {
+                    task.func(task.arg);
+                    if (__sync_sub_and_fetch(task.pending, 1) == 0) {
+                        pthread_mutex_lock(&pool._lock);
+                        pthread_cond_broadcast(&pool._done_cond);
+                        pthread_mutex_unlock(&pool._lock);
+                    }
+                    continue;
+                }
+
+                pthread_mutex_lock(&pool._lock);
+                while (pool._task_count == 0 && !pool._stop) {
+                    pthread_cond_wait(&pool._task_cond, &pool._lock);
+                }
+                bool stop = (pool._task_count == 0 && pool._stop);
+                pthread_mutex_unlock(&pool._lock);
+                if (stop) {
+                    break;
+                }
+                if (pool._task_count > 0) {
+                    // another thread is taking the task.
+                    sched_yield();
+                }
+            }
+            return NULL;
+        }
+};
+
+/*
+ * run jobs on a temporary pool.
+ * use a long-lived ThreadPool_t if jobs are run again and again.
+ */
 template<typename Job_t> 
 void multi_thread_jobs(void* (func_t)(void*), Job_t* job_context, size_t job_num, size_t thread_num)
 {
-    size_t n=0;
-    pthread_t* tids = new pthread_t[job_num];
-    bool* run = new bool[thread_num];
-    memset(run, 0, sizeof(bool)*thread_num);
-
-    while (n<job_num) {
-        for (size_t i=0; i<thread_num; ++i) {
-            bool empty = false;
-            if (!run[i]) {
-                empty = true;
-            } else {
-                // fake kill.
-                int kill_ret = pthread_kill(tids[i], 0);
-                if (kill_ret == ESRCH) {
-                    pthread_join(tids[i], NULL);
-                    empty = true;
+    if (job_num == 0) {
+        return ;
+    }
+    if (thread_num > job_num) {
+        thread_num = job_num;
+    }
+    ThreadPool_t pool(thread_num);
+    pool.run_jobs(func_t, job_context, job_num);
+}
+
+/*
+ * unsigned order of keys is the order of floats.
+ * -0.0 and 0.0 get the same key.
+ */
+inline uint32_t float_radix_key(float f) {
+    if (f == 0) {
+        f = 0;
+    }
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    // negative: flip all bits, positive: flip sign bit.
+    return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+/*
+ * stable LSD radix sort of data[0, n) by float key_of(item), 8 bits a pass.
+ *  buffer holds n items. passes where all keys share the byte are skipped.
+ *  if reverse_ties is set, items of the same key are kept in reversed
+ *  order, as if data were reversed before sorting.
+ */
+template<typename T, typename KeyFunc_t>
+void radix_sort_float(T* data, size_t n, T* buffer, KeyFunc_t key_of, bool reverse_ties=false) {
+    if (n <= 1) {
+        return ;
+    }
+    size_t count[4][256];
+    memset(count, 0, sizeof(count));
+    for (size_t i=0; i<n; ++i) {
+        uint32_t k = float_radix_key(key_of(data[i]));
+        count[0][k & 0xff] ++;
+        count[1][(k >> 8) & 0xff] ++;
+        count[2][(k >> 16) & 0xff] ++;
+        count[3][k >> 24] ++;
+    }
+
+    T* src = data;
+    T* dst = buffer;
+    bool first = true;
+    for (int pass=0; pass<4; ++pass) {
+        int shift = pass * 8;
+        if (count[pass][(float_radix_key(key_of(data[0])) >> shift) & 0xff] == n) {
+            continue;
+        }
+        size_t pos[256];
+        size_t sum = 0;
+        for (int b=0; b<256; ++b) {
+            pos[b] = sum;
+            sum += count[pass][b];
+        }
+        if (first && reverse_ties) {
+            for (size_t i=n; i>0; --i) {
+                uint32_t k = float_radix_key(key_of(src[i-1]));
+                dst[pos[(k >> shift) & 0xff] ++] = src[i-1];
+            }
+        } else {
+            for (size_t i=0; i<n; ++i) {
+                uint32_t k = float_radix_key(key_of(src[i]));
+                dst[pos[(k >> shift) & 0xff] ++] = src[i];
+            }
+        }
+        first = false;
+        swap(src, dst);
+    }
+
+    if (first && reverse_ties) {
+        // one key for all, no pass is run.
+        std::reverse(data, data + n);
+    } else if (src != data) {
+        memcpy(data, src, sizeof(T) * n);
+    }
+}
+
+/*
+ * job of parallel_sort():
+ *  sort out[begin, end) (by sort_part with buffer[begin, end) if given), 
+ *  or merge a and b into out[begin, end) (begin/end are offsets of whole merge), 
+ *  or copy a to out.
+ */
+template<typename T>
+struct __ParallelSortJob_t {
+    enum { Sort, Merge, Copy } type;
+    void (*sort_part)(T* begin, T* end, T* buffer);
+    T* buffer;
+    const T* a;
+    size_t na;
+    const T* b;
+    size_t nb;
+    T* out;
+    size_t begin;
+    size_t end;
+};
+
+/*
+ * how many of a are in the first d items of std::merge(a, b).
+ */
+template<typename T>
+size_t __merge_split(const T* a, size_t na, const T* b, size_t nb, size_t d) {
+    size_t lo = (d > nb) ? d - nb : 0;
+    size_t hi = (d < na) ? d : na;
+    while (lo < hi) {
+        size_t i = (lo + hi) / 2;
+        size_t j = d - i;
+        // std::merge takes a[i] before b[j-1] unless b[j-1] < a[i].
+        if (j == 0 || b[j-1] < a[i]) {
+            hi = i;
+        } else {
+            lo = i + 1;
+        }
+    }
+    return lo;
+}
+
+template<typename T>
+void* __parallel_sort_job(void* c) {
+    __ParallelSortJob_t<T>& job = *(__ParallelSortJob_t<T>*)c;
+    if (job.type == __ParallelSortJob_t<T>::Sort) {
+        if (job.sort_part) {
+            job.sort_part(job.out + job.begin, job.out + job.end, job.buffer + job.begin);
+        } else {
+            std::sort(job.out + job.begin, job.out + job.end);
+        }
+    } else if (job.type == __ParallelSortJob_t<T>::Merge) {
+        size_t i0 = __merge_split(job.a, job.na, job.b, job.nb, job.begin);
+        size_t i1 = __merge_split(job.a, job.na, job.b, job.nb, job.end);
+        std::merge(job.a + i0, job.a + i1, 
+                job.b + (job.begin - i0), job.b + (job.end - i1), 
+                job.out + job.begin);
+    } else {
+        memcpy(job.out + job.begin, job.a + job.begin, sizeof(T) * (job.end - job.begin));
+    }
+    return NULL;
+}
+
+/*
+ * sort arrays[0..array_num) of n items each on pool, by operator <.
+ *  arrays are sorted together. if arrays are fewer than threads,
+ *  each array is cut into parts which are sorted then merged by pieces,
+ *  so every round has about size() jobs or more.
+ *  parts are sorted by std::sort, or by sort_part(begin, end, buffer) 
+ *  which must give the order of operator <.
+ *  extra n items of memory are used for each array if it is cut
+ *  or sort_part is given.
+ */
+template<typename T>
+void parallel_sort(ThreadPool_t* pool, T** arrays, size_t array_num, size_t n,
+        void (*sort_part)(T* begin, T* end, T* buffer)=NULL) 
+{
+    static const size_t MinPartSize = 4096;
+    if (array_num == 0 || n == 0) {
+        return ;
+    }
+    size_t parts = 1;
+    while (parts * array_num < pool->size() && n / (parts * 2) >= MinPartSize) {
+        parts *= 2;
+    }
+    #define __PART_BEGIN(p) (n * (p) / parts)
+
+    T** buffers = NULL;
+    if (parts > 1 || sort_part) {
+        buffers = new T*[array_num];
+        for (size_t k=0; k<array_num; ++k) {
+            buffers[k] = new T[n];
+        }
+    }
+
+    __ParallelSortJob_t<T>* jobs = new __ParallelSortJob_t<T>[array_num * parts];
+    for (size_t k=0; k<array_num; ++k) {
+        for (size_t p=0; p<parts; ++p) {
+            __ParallelSortJob_t<T>& job = jobs[k * parts + p];
+            job.type = __ParallelSortJob_t<T>::Sort;
+            job.sort_part = sort_part;
+            job.buffer = buffers ? buffers[k] : NULL;
+            job.out = arrays[k];
+            job.begin = __PART_BEGIN(p);
+            job.end = __PART_BEGIN(p+1);
+        }
+    }
+    pool->run_jobs(__parallel_sort_job<T>, jobs, array_num * parts);
+
+    if (parts > 1) {
+        T** src = new T*[array_num];
+        T** dst = new T*[array_num];
+        for (size_t k=0; k<array_num; ++k) {
+            src[k] = arrays[k];
+            dst[k] = buffers[k];
+        }
+
+        // merge sorted runs of width parts into runs of 2*width.
+        for (size_t width=1; width<parts; width*=2) {
+            for (size_t k=0; k<array_num; ++k) {
+                for (size_t p=0; p<parts; ++p) {
+                    size_t g = p / (2 * width) * (2 * width);
+                    size_t a_begin = __PART_BEGIN(g);
+                    size_t b_begin = __PART_BEGIN(g + width);
+                    size_t b_end = __PART_BEGIN(g + 2 * width);
+
+                    __ParallelSortJob_t<T>& job = jobs[k * parts + p];
+                    job.type = __ParallelSortJob_t<T>::Merge;
+                    job.a = src[k] + a_begin;
+                    job.na = b_begin - a_begin;
+                    job.b = src[k] + b_begin;
+                    job.nb = b_end - b_begin;
+                    job.out = dst[k] + a_begin;
+                    job.begin = __PART_BEGIN(p) - a_begin;
+                    job.end = __PART_BEGIN(p+1) - a_begin;
                 }
+                swap(src[k], dst[k]);
             }
+            pool->run_jobs(__parallel_sort_job<T>, jobs, array_num * parts);
+        }
 
-            if (empty) {
-                // thread is over.
-                //LOG_NOTICE("job[%d] is started @T%d.", n, i);
-                pthread_create(tids+i, NULL, func_t, job_context+n);
-                run[i] = true;
-                n++;
-                break;
+        if (src[0] != arrays[0]) {
+            for (size_t k=0; k<array_num; ++k) {
+                for (size_t p=0; p<parts; ++p) {
+                    __ParallelSortJob_t<T>& job = jobs[k * parts + p];
+                    job.type = __ParallelSortJob_t<T>::Copy;
+                    job.a = src[k];
+                    job.out = arrays[k];
+                    job.begin = __PART_BEGIN(p);
+                    job.end = __PART_BEGIN(p+1);
+                }
             }
+            pool->run_jobs(__parallel_sort_job<T>, jobs, array_num * parts);
         }
+        delete [] src;
+        delete [] dst;
     }
-   
-    // waiting for over.
-    for (size_t i=0; i<thread_num; ++i) {
-        if (run[i]) {
-            pthread_join(tids[i], NULL);
+    #undef __PART_BEGIN
+    if (buffers) {
+        for (size_t k=0; k<array_num; ++k) {
+            delete [] buffers[k];
         }
+        delete [] buffers;
     }
-    delete [] run;
-    delete [] tids;
+    delete [] jobs;
 }
 
 #endif
@@ -13,8 +13,12 @@
 #include "cfg.h"
 
 #include <set>
+#include <limits>
+
+#include <dlfcn.h>
 
 #include <emmintrin.h>
+#include <immintrin.h>
 
 #define _PREFETCH_STEP      (12)
 #define _PREFETCH_STEP_POST (12)
@@ -29,6 +33,17 @@ int sample_const = 0;
 int sample_threshold = 256;
 #define ITEM_SAMPLE(idx) (int(((idx+137)*(sample_const+1)+79) & 0xff) <= sample_threshold)
 
+enum GBDTSplitMethod_t {
+    SM_Sorted = 0,      // scan SortedIndex_t of each feature.
+    SM_Histogram,       // scan quantized bins and find split on histogram.
+};
+
+enum GBDTPredictMethod_t {
+    PM_Tree = 0,        // walk each tree from root.
+    PM_QuickScorer,     // leaf bitmasks of nodes grouped by feature, see QuickScorer_t.
+    PM_Simd,            // walk trees for 8/16 rows at once, see SimdScorer_t.
+};
+
 struct SortedIndex_t {
     /*
      * if this bit is set:
@@ -38,38 +53,165 @@ struct SortedIndex_t {
     uint32_t index:31; 
 };
 
+/*
+ * split_id of a node whose threshold is set when it is split,
+ * _rebuild_tree() needs not read it from items.
+ */
+#define THRESHOLD_READY_ID (0xffffffff)
+
+/*
+ * present entry of a sparse feature, value is kept for threshold.
+ */
+struct SparseIndex_t {
+    uint32_t same:1; 
+    uint32_t index:31; 
+    float value;
+};
+
+/*
+ * sorted column of a sparse feature, only items having the feature are kept.
+ * the others are missing values.
+ *  data[0, neg) are negative values.
+ */
+struct SparseColumn_t {
+    uint32_t present;
+    uint32_t neg;
+    SparseIndex_t* data;
+
+    SparseColumn_t():
+        present(0),
+        neg(0),
+        data(NULL)
+    {}
+
+    ~SparseColumn_t() {
+        if (data) {
+            delete [] data;
+        }
+    }
+
+    void write(FILE* stream) const {
+        fwrite(&present, 1, sizeof(present), stream);
+        fwrite(&neg, 1, sizeof(neg), stream);
+        fwrite(data, present, sizeof(SparseIndex_t), stream);
+    }
+
+    void read(FILE* stream) {
+        if (data) {
+            delete [] data;
+        }
+        fseek(stream, 0, SEEK_SET);
+        fread(&present, 1, sizeof(present), stream);
+        fread(&neg, 1, sizeof(neg), stream);
+        data = new SparseIndex_t[present];
+        fread(data, present, sizeof(SparseIndex_t), stream);
+    }
+
+    /*
+     * full sorted index of count items as a dense feature has,
+     * missing values are taken as zero.
+     *  zeros are in reversed item order like other ties.
+     */
+    void expand(SortedIndex_t* out, size_t count) const {
+        vector<bool> nonzero(count, false);
+        for (uint32_t i=0; i<present; ++i) {
+            if (data[i].value != 0) {
+                nonzero[data[i].index] = true;
+            }
+        }
+        size_t c = 0;
+        for (uint32_t i=0; i<neg; ++i, ++c) {
+            out[c].same = data[i].same;
+            out[c].index = data[i].index;
+        }
+        bool first_zero = true;
+        for (size_t i=count; i>0; --i) {
+            if (nonzero[i-1]) {
+                continue;
+            }
+            out[c].same = first_zero ? 0 : 1;
+            out[c].index = i-1;
+            first_zero = false;
+            c ++;
+        }
+        uint32_t positive = neg;
+        while (positive < present && data[positive].value == 0) {
+            positive ++;
+        }
+        for (uint32_t i=positive; i<present; ++i, ++c) {
+            out[c].same = (i==positive) ? 0 : data[i].same;
+            out[c].index = data[i].index;
+        }
+    }
+};
+
+/*
+ * scan state and best split of a layer node on the feature being scanned.
+ * each pool thread keeps one for every node of layer, and reuses them
+ * for all features, layers and trees.
+ */
+struct NodeScan_t {
+    // copied from master tree.
+    int begin;
+    int cnt;
+    double sum;
+    double square_sum;
+
+    int grow;   // items scanned.
+    uint32_t same_key;
+    double temp_sum;
+    double temp_ssum;
+
+    // sparse feature: items having the feature.
+    int present_cnt;
+    double present_sum;
+    double present_ssum;
+
+    // best split.
+    bool found;
+    float score;
+    int split;
+    uint32_t split_id;
+    int split_present;
+    float threshold;
+    bool default_left;
+    double split_sum;
+    double split_ssum;
+};
+
 struct TreeNode_t {
     // Decision info.
     int fidx;   // feature index.
     double threshold;  // threshold.
     double mean;     // predict value.
+    bool default_left;  // missing value goes left.
+    int left;   // left child, right child is left+1. -1 : not splitted yet.
 
     // Training info.
     float score;    // mse delta.
+    double gain;    // decrease of squared error by the split.
     int begin;
     int end;
     int cnt;
 
     int split;
+    int split_bin;  // histogram mode: bins<=split_bin go left.
+    int split_present;  // sparse feature: present items going left.
     uint32_t split_id;
     double split_sum;
     double split_ssum;
 
-    // aid info.
-    int grow; // help for O(n) sort..
-    uint32_t same_key;
-
     double sum;
     double square_sum;
 
-    double temp_sum;
-    double temp_ssum;
-
     void init(size_t b, size_t e) {
         fidx = -1;
         mean = 0;
         threshold = 0;
+        default_left = false;
+        left = -1;
         score = 0;
+        gain = 0;
 
         begin = b;
         end = e;
@@ -77,13 +219,15 @@ struct TreeNode_t {
         split = b;
         split_id = 0;
 
-        grow = b;
-        same_key = INVALID_SAME_KEY;
         sum = 0;
         square_sum = 0;
     }
 
-    int read(FILE* stream) {
+    /*
+     * with_default=false : model of old format, missing value is taken as zero.
+     * with_child=false : model of heap layout, left is set by caller.
+     */
+    int read(FILE* stream, bool with_default=true, bool with_child=true) {
         int res = 0;
         res = fread(&fidx, 1, sizeof(fidx), stream);
         if ( res == 0 )
@@ -94,6 +238,17 @@ struct TreeNode_t {
         fread(&mean, 1, sizeof(mean), stream);
         if ( res == 0 )
             return 0;
+        if (with_default) {
+            char c = 0;
+            fread(&c, 1, sizeof(c), stream);
+            default_left = (c != 0);
+        } else {
+            default_left = (0 < threshold);
+        }
+        left = -1;
+        if (with_child) {
+            fread(&left, 1, sizeof(left), stream);
+        }
         return 1;
     }
 
@@ -101,6 +256,9 @@ struct TreeNode_t {
         fwrite(&fidx, 1, sizeof(fidx), stream);
         fwrite(&threshold, 1, sizeof(threshold), stream);
         fwrite(&mean, 1, sizeof(mean), stream);
+        char c = default_left ? 1 : 0;
+        fwrite(&c, 1, sizeof(c), stream);
+        fwrite(&left, 1, sizeof(left), stream);
     }
 
     bool operator< (const TreeNode_t& o) const {
@@ -114,8 +272,9 @@ struct TreeNode_t {
         if (cnt>0) {
             orig_score = (square_sum - mean*mean) / cnt;
         }
-        snprintf(buf, sizeof(buf), "{(f_%d<%f (item%d.f_%d)) score:%f=>%f %d=%d+%d)}",
+        snprintf(buf, sizeof(buf), "{(f_%d<%f missing:%s (item%d.f_%d)) score:%f=>%f %d=%d+%d)}",
                 fidx, threshold, 
+                default_left ? "left" : "right",
                 split_id, fidx, 
                 orig_score, score, 
                 cnt, 
@@ -128,19 +287,586 @@ struct TreeNode_t {
 struct SmallTreeNode_t {
     // Decision info.
     short fidx;   // feature index.
+    bool default_left;  // missing value goes left.
     float threshold;  // threshold.
+    int left;   // left child, right child is left+1.
 
     void init(size_t b, size_t e) {
         fidx = -1;
+        default_left = false;
         threshold = 0;
+        left = -1;
     }
 
     void copy(const TreeNode_t& o) {
         fidx = o.fidx;
+        default_left = o.default_left;
         threshold = o.threshold;
+        left = o.left;
     }
 };
 
+/*
+ * models with default direction of missing value begin with this tag,
+ * models of old format begin with tree count.
+ */
+#define GBDT_MODEL_TAG_DEFAULT_DIRECTION (-2)
+/*
+ * models with child index of nodes begin with this tag, 
+ * nodes of former formats are in heap layout: children of x are 2x+1, 2x+2.
+ */
+#define GBDT_MODEL_TAG_CHILD_INDEX (-3)
+
+/*
+ * QuickScorer evaluator of a tree ensemble.
+ *  leaves of each tree are numbered from left to right. a node whose test
+ *  is false (value goes right) clears the leaves of its left subtree from
+ *  the leaf mask of its tree, the exit leaf is the lowest bit left.
+ *  nodes are grouped by feature and sorted by threshold, so false nodes
+ *  of a value are a prefix of its group, no branch depends on tree shape.
+ *  missing value (NaN) is false on nodes whose default side is right.
+ *  rows are scored in blocks, so nodes of a feature stay in cache for all
+ *  rows of a block.
+ *  trees with more than MaxLeaves leaves are walked from root.
+ */
+class QuickScorer_t {
+    public:
+        static const int MaxLeaves = 64;
+
+        QuickScorer_t() : _tree_count(0), _trees(NULL) {}
+
+        void build(SmallTreeNode_t** trees, float** mean, int tree_count, int dim) {
+            _tree_count = tree_count;
+            _trees = trees;
+            _leaf_node.assign(tree_count * MaxLeaves, 0);
+            _leaf_value.assign(tree_count * MaxLeaves, 0);
+            _walk_value.assign(tree_count, NULL);
+            _features.clear();
+
+            vector< vector<BuildNode_t> > groups(dim);
+            size_t walk_count = 0;
+            for (int T=0; T<tree_count; ++T) {
+                vector<int> leaves;
+                vector<BuildNode_t> nodes;
+                if (!_collect(trees[T], 0, T, &leaves, &nodes)) {
+                    _walk_value[T] = mean[T];
+                    walk_count ++;
+                    continue;
+                }
+                for (size_t k=0; k<leaves.size(); ++k) {
+                    _leaf_node[T * MaxLeaves + k] = leaves[k];
+                    _leaf_value[T * MaxLeaves + k] = mean[T][ leaves[k] ];
+                }
+                for (size_t k=0; k<nodes.size(); ++k) {
+                    groups[ nodes[k].fidx ].push_back(nodes[k]);
+                }
+            }
+
+            // each group ends with a sentinel of +inf threshold.
+            _offset.assign(dim, 0);
+            _missing_offset.assign(dim + 1, 0);
+            _nodes.clear();
+            _missing_nodes.clear();
+            size_t node_count = 0;
+            for (int f=0; f<dim; ++f) {
+                _offset[f] = _nodes.size();
+                _missing_offset[f] = _missing_nodes.size();
+                if (groups[f].empty()) {
+                    continue;
+                }
+                _features.push_back(f);
+                sort(groups[f].begin(), groups[f].end());
+                for (size_t k=0; k<groups[f].size(); ++k) {
+                    const BuildNode_t& node = groups[f][k];
+                    _nodes.push_back(node.node);
+                    if (node.missing_right) {
+                        _missing_nodes.push_back(node.node);
+                    }
+                }
+                node_count += groups[f].size();
+
+                Node_t sentinel;
+                sentinel.threshold = std::numeric_limits<float>::infinity();
+                sentinel.tree = 0;
+                sentinel.mask = ~0ULL;
+                _nodes.push_back(sentinel);
+            }
+            _missing_offset[dim] = _missing_nodes.size();
+            LOG_NOTICE("QuickScorer: trees=%d nodes=%d features=%d walked_trees=%d",
+                    tree_count, (int)node_count, (int)_features.size(), (int)walk_count);
+        }
+
+        /*
+         * score rows of dense values: row r is values[r*stride, r*stride+dim).
+         *  sum of exit leaf values of the first tree_count trees is out[r].
+         *  masks : scratch of rows * tree_count() words.
+         */
+        void score_block(const float* values, size_t stride, int rows, int tree_count, 
+                uint64_t* masks, float* out) const
+        {
+            _fill_masks(values, stride, rows, masks);
+            for (int r=0; r<rows; ++r) {
+                out[r] = _exit(values + r * stride, tree_count, masks + r * _tree_count, NULL, NULL);
+            }
+        }
+
+        /*
+         * score of one row.
+         *  leaves, means : exit node and value of each tree if not NULL.
+         */
+        float score(const float* values, int tree_count, uint64_t* masks, 
+                int* leaves=NULL, float* means=NULL) const 
+        {
+            _fill_masks(values, 0, 1, masks);
+            return _exit(values, tree_count, masks, leaves, means);
+        }
+
+        /*
+         * rows of a score_block() call whose masks are about 64KB.
+         */
+        int block_rows() const {
+            int rows = 8192 / (_tree_count > 0 ? _tree_count : 1);
+            return rows > 0 ? rows : 1;
+        }
+
+        int tree_count() const { return _tree_count; }
+
+    private:
+        struct Node_t {
+            float threshold;
+            uint32_t tree;
+            uint64_t mask;
+        };
+
+        struct BuildNode_t {
+            Node_t node;
+            int fidx;
+            bool missing_right;
+
+            bool operator < (const BuildNode_t& o) const {
+                return node.threshold < o.node.threshold;
+            }
+        };
+
+        int _tree_count;
+        SmallTreeNode_t** _trees;
+        vector<int>     _leaf_node;     // [tree * MaxLeaves + leaf] : node id.
+        vector<float>   _leaf_value;
+        vector<float*>  _walk_value;    // [tree] : means of a walked tree, NULL for others.
+
+        // nodes of feature f begin at _offset[f], sorted by threshold.
+        // nodes with default side right of f are 
+        //   _missing_nodes[_missing_offset[f], _missing_offset[f+1]).
+        vector<int>     _features;      // features having nodes.
+        vector<uint32_t> _offset;
+        vector<Node_t>  _nodes;
+        vector<uint32_t> _missing_offset;
+        vector<Node_t>  _missing_nodes;
+
+        void _fill_masks(const float* values, size_t stride, int rows, uint64_t* masks) const {
+            for (int i=0; i<rows * _tree_count; ++i) {
+                masks[i] = ~0ULL;
+            }
+            for (size_t i=0; i<_features.size(); ++i) {
+                int f = _features[i];
+                const Node_t* group = &_nodes[ _offset[f] ];
+                for (int r=0; r<rows; ++r) {
+                    float v = values[r * stride + f];
+                    uint64_t* m = masks + r * _tree_count;
+                    if (v != v) {
+                        for (uint32_t k=_missing_offset[f]; k<_missing_offset[f+1]; ++k) {
+                            m[ _missing_nodes[k].tree ] &= _missing_nodes[k].mask;
+                        }
+                        continue;
+                    }
+                    // sentinel stops the scan.
+                    if (v > std::numeric_limits<float>::max()) {
+                        v = std::numeric_limits<float>::max();
+                    }
+                    for (const Node_t* node=group; node->threshold <= v; ++node) {
+                        m[ node->tree ] &= node->mask;
+                    }
+                }
+            }
+        }
+
+        float _exit(const float* values, int tree_count, const uint64_t* masks, 
+                int* leaves, float* means) const 
+        {
+            float ret = 0.0f;
+            for (int T=0; T<tree_count; ++T) {
+                int nid;
+                float value;
+                if (_walk_value[T]) {
+                    nid = _walk(_trees[T], values);
+                    value = _walk_value[T][nid];
+                } else {
+                    int leaf = T * MaxLeaves + __builtin_ctzll(masks[T]);
+                    nid = _leaf_node[leaf];
+                    value = _leaf_value[leaf];
+                }
+                if (leaves) {
+                    leaves[T] = nid;
+                }
+                if (means) {
+                    means[T] = value;
+                }
+                ret += value;
+            }
+            return ret;
+        }
+
+        /*
+         * leaves of subtree nid from left to right, and its split nodes.
+         * return false if the tree has more than MaxLeaves leaves.
+         */
+        bool _collect(const SmallTreeNode_t* tree, int nid, int T, 
+                vector<int>* leaves, vector<BuildNode_t>* nodes) const 
+        {
+            const SmallTreeNode_t& node = tree[nid];
+            if (node.fidx == -1) {
+                leaves->push_back(nid);
+                return leaves->size() <= (size_t)MaxLeaves;
+            }
+            size_t lo = leaves->size();
+            if (!_collect(tree, node.left, T, leaves, nodes)) {
+                return false;
+            }
+            size_t hi = leaves->size();
+            if (!_collect(tree, node.left + 1, T, leaves, nodes)) {
+                return false;
+            }
+            uint64_t left_bits = ((hi - lo == 64) ? ~0ULL : ((1ULL << (hi - lo)) - 1)) << lo;
+
+            BuildNode_t qs_node;
+            qs_node.node.threshold = node.threshold;
+            qs_node.node.tree = T;
+            qs_node.node.mask = ~left_bits;
+            qs_node.fidx = node.fidx;
+            qs_node.missing_right = !node.default_left;
+            nodes->push_back(qs_node);
+            return true;
+        }
+
+        int _walk(const SmallTreeNode_t* tree, const float* values) const {
+            int nid = 0;
+            while (tree[nid].fidx != -1) {
+                const SmallTreeNode_t& node = tree[nid];
+                float v = values[node.fidx];
+                nid = node.left;
+                if (v >= node.threshold || (v != v && !node.default_left)) {
+                    nid ++;
+                }
+            }
+            return nid;
+        }
+};
+
+
+/*
+ * walk each tree for a group of rows in SIMD lanes (AVX-512: 16, AVX2: 8),
+ * node fields are gathered by node id of each lane.
+ *  nodes of all trees are kept in arrays, a leaf is a node which goes
+ *  left to itself (threshold is NaN), so every tree is walked for its
+ *  depth steps without checking leaves.
+ *  instruction set is chosen at build() by cpu, scalar walk is the fallback.
+ */
+class SimdScorer_t {
+    public:
+        enum Isa_t {
+            ISA_Scalar = 0,
+            ISA_AVX2,
+            ISA_AVX512,
+        };
+
+        SimdScorer_t() : _tree_count(0), _isa(ISA_Scalar) {}
+
+        /*
+         * isa=-1 : best one supported by cpu.
+         */
+        void build(SmallTreeNode_t** trees, float** mean, int tree_count, int tree_size, int isa=-1) {
+            _tree_count = tree_count;
+            _depth.assign(tree_count, 0);
+            _base.assign(tree_count, 0);
+            _feature.resize(tree_count * tree_size);
+            _threshold.resize(tree_count * tree_size);
+            _left.resize(tree_count * tree_size);
+            _missing_right.resize(tree_count * tree_size);
+            _value.resize(tree_count * tree_size);
+
+            for (int T=0; T<tree_count; ++T) {
+                int base = T * tree_size;
+                _base[T] = base;
+                for (int i=0; i<tree_size; ++i) {
+                    const SmallTreeNode_t& node = trees[T][i];
+                    _value[base + i] = mean[T][i];
+                    if (node.fidx == -1) {
+                        _feature[base + i] = 0;
+                        _threshold[base + i] = std::numeric_limits<float>::quiet_NaN();
+                        _left[base + i] = base + i;
+                        _missing_right[base + i] = 0;
+                    } else {
+                        _feature[base + i] = node.fidx;
+                        _threshold[base + i] = node.threshold;
+                        _left[base + i] = base + node.left;
+                        _missing_right[base + i] = node.default_left ? 0 : -1;
+                    }
+                }
+                // depth of reachable nodes.
+                vector< pair<int, int> > stack(1, make_pair(0, 0));
+                while (!stack.empty()) {
+                    pair<int, int> top = stack.back();
+                    stack.pop_back();
+                    const SmallTreeNode_t& node = trees[T][top.first];
+                    if (node.fidx == -1) {
+                        if (_depth[T] < top.second) {
+                            _depth[T] = top.second;
+                        }
+                        continue;
+                    }
+                    stack.push_back(make_pair(node.left, top.second + 1));
+                    stack.push_back(make_pair(node.left + 1, top.second + 1));
+                }
+            }
+
+            if (isa < 0) {
+                isa = ISA_Scalar;
+                if (__builtin_cpu_supports("avx2")) {
+                    isa = ISA_AVX2;
+                }
+                if (__builtin_cpu_supports("avx512f")) {
+                    isa = ISA_AVX512;
+                }
+            }
+            _isa = (Isa_t)isa;
+            const char* isa_name[] = {"scalar", "avx2", "avx512"};
+            LOG_NOTICE("SimdScorer: trees=%d isa=%s lanes=%d", tree_count, isa_name[_isa], lanes());
+        }
+
+        /*
+         * score rows of dense values: row r is values[r*stride, r*stride+dim).
+         *  sum of leaf values of the first tree_count trees is out[r].
+         *  rows * stride must fit in int.
+         */
+        void score_block(const float* values, int stride, int rows, int tree_count, float* out) const {
+            int r = 0;
+            if (_isa == ISA_AVX512) {
+                for (; r+16<=rows; r+=16) {
+                    _score16_avx512(values + r * stride, stride, tree_count, out + r);
+                }
+            } else if (_isa == ISA_AVX2) {
+                for (; r+8<=rows; r+=8) {
+                    _score8_avx2(values + r * stride, stride, tree_count, out + r);
+                }
+            }
+            for (; r<rows; ++r) {
+                out[r] = _score_scalar(values + r * stride, tree_count);
+            }
+        }
+
+        int lanes() const {
+            const int lanes[] = {1, 8, 16};
+            return lanes[_isa];
+        }
+
+        int tree_count() const { return _tree_count; }
+
+    private:
+        int _tree_count;
+        Isa_t _isa;
+        vector<int>     _depth;
+        vector<int>     _base;      // [tree] : index of root.
+        // [node] : global node index.
+        vector<int>     _feature;
+        vector<float>   _threshold;
+        vector<int>     _left;
+        vector<int>     _missing_right;     // -1 : missing value goes right.
+        vector<float>   _value;
+
+        float _score_scalar(const float* values, int tree_count) const {
+            float ret = 0.0f;
+            for (int T=0; T<tree_count; ++T) {
+                int nid = _base[T];
+                for (int d=0; d<_depth[T]; ++d) {
+                    float v = values[ _feature[nid] ];
+                    bool right = (v >= _threshold[nid]) || (v != v && _missing_right[nid]);
+                    nid = _left[nid] + (right ? 1 : 0);
+                }
+                ret += _value[nid];
+            }
+            return ret;
+        }
+
+        __attribute__((target("avx2")))
+        void _score8_avx2(const float* values, int stride, int tree_count, float* out) const {
+            const __m256i row_offset = _mm256_mullo_epi32(
+                    _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+            __m256 sum = _mm256_setzero_ps();
+            for (int T=0; T<tree_count; ++T) {
+                __m256i nid = _mm256_set1_epi32(_base[T]);
+                for (int d=0; d<_depth[T]; ++d) {
+                    __m256i f = _mm256_i32gather_epi32(&_feature[0], nid, 4);
+                    __m256 thr = _mm256_i32gather_ps(&_threshold[0], nid, 4);
+                    __m256i left = _mm256_i32gather_epi32(&_left[0], nid, 4);
+                    __m256i missing_right = _mm256_i32gather_epi32(&_missing_right[0], nid, 4);
+                    __m256 v = _mm256_i32gather_ps(values, _mm256_add_epi32(row_offset, f), 4);
+
+                    __m256 right = _mm256_or_ps(
+                            _mm256_cmp_ps(v, thr, _CMP_GE_OQ),
+                            _mm256_and_ps(_mm256_cmp_ps(v, v, _CMP_UNORD_Q), _mm256_castsi256_ps(missing_right)));
+                    // right lanes are -1.
+                    nid = _mm256_sub_epi32(left, _mm256_castps_si256(right));
+                }
+                sum = _mm256_add_ps(sum, _mm256_i32gather_ps(&_value[0], nid, 4));
+            }
+            _mm256_storeu_ps(out, sum);
+        }
+
+        __attribute__((target("avx512f")))
+        void _score16_avx512(const float* values, int stride, int tree_count, float* out) const {
+            const __m512i row_offset = _mm512_mullo_epi32(
+                    _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                    _mm512_set1_epi32(stride));
+            const __m512i one = _mm512_set1_epi32(1);
+            __m512 sum = _mm512_setzero_ps();
+            for (int T=0; T<tree_count; ++T) {
+                __m512i nid = _mm512_set1_epi32(_base[T]);
+                for (int d=0; d<_depth[T]; ++d) {
+                    __m512i f = _mm512_i32gather_epi32(nid, &_feature[0], 4);
+                    __m512 thr = _mm512_i32gather_ps(nid, &_threshold[0], 4);
+                    __m512i left = _mm512_i32gather_epi32(nid, &_left[0], 4);
+                    __m512i missing_right = _mm512_i32gather_epi32(nid, &_missing_right[0], 4);
+                    __m512 v = _mm512_i32gather_ps(_mm512_add_epi32(row_offset, f), values, 4);
+
+                    __mmask16 right = _mm512_cmp_ps_mask(v, thr, _CMP_GE_OQ)
+                        | (_mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q) & _mm512_test_epi32_mask(missing_right, missing_right));
+                    nid = _mm512_mask_add_epi32(left, right, left, one);
+                }
+                sum = _mm512_add_ps(sum, _mm512_i32gather_ps(nid, &_value[0], 4));
+            }
+            _mm512_storeu_ps(out, sum);
+        }
+};
+
+
+/*
+ * all trees in one arena of 8-byte nodes, for walking trees from root.
+ *  only reachable nodes are kept, in breadth-first order, so the upper
+ *  layers share the first cache lines. children of a node are adjacent
+ *  (left, left+1), a leaf keeps its score in place of threshold, so no
+ *  mean array is read.
+ *  every tree begins at a cache line.
+ */
+class PackedForest_t {
+    public:
+        struct Node_t {
+            float value;            // threshold, or score of leaf.
+            short fidx;             // -1 : leaf.
+            unsigned short left;    // bit 15 : default_left, others : left child in tree.
+        };
+        static const int NodesPerLine = 64 / sizeof(Node_t);
+        static const int MaxTreeNodes = 0x7fff;
+
+        PackedForest_t() : _tree_count(0), _align(0) {}
+
+        /*
+         * return false if any tree has more than MaxTreeNodes nodes.
+         */
+        bool build(SmallTreeNode_t** trees, float** mean, int tree_count) {
+            _tree_count = 0;
+            _offset.assign(tree_count, 0);
+            vector<Node_t> nodes;
+            vector<int> origin;
+            for (int T=0; T<tree_count; ++T) {
+                while (nodes.size() % NodesPerLine) {
+                    Node_t pad = {0.0f, -1, 0};
+                    nodes.push_back(pad);
+                }
+                _offset[T] = nodes.size();
+
+                // origin[k] : node of trees[T] at slot k.
+                origin.assign(1, 0);
+                for (size_t k=0; k<origin.size(); ++k) {
+                    const SmallTreeNode_t& node = trees[T][origin[k]];
+                    Node_t p;
+                    if (node.fidx == -1) {
+                        p.value = mean[T][origin[k]];
+                        p.fidx = -1;
+                        p.left = 0;
+                    } else {
+                        if (origin.size() + 2 > (size_t)MaxTreeNodes) {
+                            LOG_ERROR("PackedForest: tree[%d] has more than %d nodes.", T, MaxTreeNodes);
+                            return false;
+                        }
+                        p.value = node.threshold;
+                        p.fidx = node.fidx;
+                        p.left = origin.size() | (node.default_left ? 0x8000 : 0);
+                        origin.push_back(node.left);
+                        origin.push_back(node.left + 1);
+                    }
+                    nodes.push_back(p);
+                }
+            }
+
+            // arena begins at a cache line.
+            _arena.resize(nodes.size() + NodesPerLine);
+            _align = (64 - (size_t)&_arena[0] % 64) % 64 / sizeof(Node_t);
+            copy(nodes.begin(), nodes.end(), _arena.begin() + _align);
+            _tree_count = tree_count;
+            LOG_NOTICE("PackedForest: trees=%d nodes=%llu bytes=%llu",
+                    tree_count, (unsigned long long)nodes.size(),
+                    (unsigned long long)(nodes.size() * sizeof(Node_t)));
+            return true;
+        }
+
+        /*
+         * sum of scores of the first tree_count trees on dense values.
+         */
+        float score(const float* values, int tree_count) const {
+            const Node_t* arena = &_arena[0] + _align;
+            float ret = 0.0f;
+            for (int T=0; T<tree_count; ++T) {
+                ret += _walk(arena + _offset[T], values);
+            }
+            return ret;
+        }
+
+        /*
+         * add scores to out[0, rows), row r is values[r*stride, r*stride+dim).
+         *  each tree is walked for all rows before the next tree.
+         */
+        void score_block(const float* values, int stride, size_t rows, int tree_count, float* out) const {
+            const Node_t* arena = &_arena[0] + _align;
+            for (int T=0; T<tree_count; ++T) {
+                const Node_t* tree = arena + _offset[T];
+                for (size_t r=0; r<rows; ++r) {
+                    out[r] += _walk(tree, values + r * stride);
+                }
+            }
+        }
+
+        int tree_count() const { return _tree_count; }
+
+    private:
+        int             _tree_count;
+        size_t          _align;     // _arena[_align] is at a cache line.
+        vector<Node_t>  _arena;
+        vector<size_t>  _offset;    // [tree] : root of tree in arena.
+
+        static float _walk(const Node_t* tree, const float* values) {
+            int nid = 0;
+            while (tree[nid].fidx != -1) {
+                const Node_t& node = tree[nid];
+                float v = values[node.fidx];
+                nid = node.left & 0x7fff;
+                if (v >= node.value || (v != v && !(node.left & 0x8000))) {
+                    nid ++;
+                }
+            }
+            return tree[nid].value;
+        }
+};
+
 
 //#pragma pack(1)
 struct ItemInfo_t {
@@ -155,18 +881,18 @@ struct Job_LayerFeatureProcess_t {
     int feature_index;
     int beg_node;
     int end_node;
-    int all_node_count;
 
     const SortedIndex_t* finfo;
     FILE* sorted_index_fd;
 
+    // sparse feature: finfo is NULL.
+    const SparseColumn_t* sparse;
+
     ItemInfo_t* iinfo;
-    TreeNode_t* tree;
+    NodeScan_t** thread_scan;   // [pool thread][node - beg_node]
 
     TreeNode_t*  master_tree;
     Lock_t*      locks;
-
-    int *dim_id_sorted;
 };
 
 /**
@@ -191,35 +917,92 @@ inline float __mid_mse_score(float la, int lc, float ra, int rc)
     return ret;
 }
 
+/*
+ * scan state of layer nodes in the calling thread.
+ */
+NodeScan_t* __layer_scan_init(const Job_LayerFeatureProcess_t& job) {
+    NodeScan_t* scan = job.thread_scan[ ThreadPool_t::worker_index() ];
+    for (int n=job.beg_node; n<job.end_node; ++n) {
+        const TreeNode_t& m = job.master_tree[n];
+        NodeScan_t& sc = scan[n - job.beg_node];
+        sc.begin = m.begin;
+        sc.cnt = m.end - m.begin;
+        sc.sum = m.sum;
+        sc.square_sum = m.square_sum;
+
+        sc.grow = m.begin;
+        sc.same_key = INVALID_SAME_KEY;
+        sc.temp_sum = 0;
+        sc.temp_ssum = 0;
+
+        sc.present_cnt = 0;
+        sc.present_sum = 0;
+        sc.present_ssum = 0;
+
+        sc.found = false;
+        sc.score = __mid_mse_score(0, 0, sc.sum, sc.cnt);
+        sc.split_present = 0;
+        sc.threshold = 0;
+        sc.default_left = false;
+    }
+    return scan;
+}
+
+/*
+ * copy better splits found on job.feature_index to master tree,
+ * children are created when the split is applied.
+ * return count of updated nodes.
+ */
+int __update_master_nodes(Job_LayerFeatureProcess_t& job, const NodeScan_t* scan) {
+    TreeNode_t* master_tree = job.master_tree;
+    int update_node_counter = 0;
+    for (int n=job.beg_node; n<job.end_node; ++n) {
+        const NodeScan_t& sc = scan[n - job.beg_node];
+        if (!sc.found) {
+            continue;
+        }
+        // change score from middle-score to MSE.
+        float score = (sc.square_sum - sc.score) / sc.cnt;
+
+        job.locks[n].lock();
+        TreeNode_t& node = master_tree[n];
+        if (node.fidx == -1 || node.score > score) {
+            update_node_counter ++;
+            node.fidx = job.feature_index;
+            node.score = score;
+            node.split = sc.split;
+            node.split_id = sc.split_id;
+            node.split_present = sc.split_present;
+            node.threshold = sc.threshold;
+            node.default_left = sc.default_left;
+            node.split_sum = sc.split_sum;
+            node.split_ssum = sc.split_ssum;
+            node.gain = sc.score - sc.sum * sc.sum / sc.cnt;
+        }
+        job.locks[n].unlock();
+    }
+    return update_node_counter;
+}
+
 void* __worker_layer_processor(void* input) {
 
     Timer t_calc, t_post;
 
     Job_LayerFeatureProcess_t& job= *(Job_LayerFeatureProcess_t*)input;
     if (!job.selected) {
-        pthread_exit(0);
-    }
-
-    // reset growth id.
-    for (int i=0; i<job.all_node_count; ++i) {
-        job.tree[i].grow = job.tree[i].begin;
-        job.tree[i].same_key = INVALID_SAME_KEY;
-    }
-    for (int i=job.beg_node; i<job.end_node; ++i) {
-        job.tree[i].temp_sum = 0;
-        job.tree[i].cnt = job.tree[i].end - job.tree[i].begin;
-        job.tree[i].score = __mid_mse_score(0, 0, job.tree[i].sum, job.tree[i].cnt);
+        return NULL;
     }
 
     t_calc.begin();
+    NodeScan_t* scan = __layer_scan_init(job);
 
     // critical time demand.
     // make sort step over. in O(n)
     uint32_t same_key = INVALID_SAME_KEY;
     ItemInfo_t* iinfo = job.iinfo;
     uint32_t item_count = job.item_count;
-    register int *dim_id_sorted = job.dim_id_sorted;
-    TreeNode_t* master_tree = job.master_tree;
+    int beg_node = job.beg_node;
+    uint32_t node_count = job.end_node - job.beg_node;
 
     uint32_t update_cnt = 0;
     uint32_t update_try = 0;
@@ -237,24 +1020,28 @@ void* __worker_layer_processor(void* input) {
             same_key = i;
         }
         
-        register uint32_t ind = si.index;
+        uint32_t ind = si.index;
         // sample out not useful data.
         if ( !ITEM_SAMPLE(ind) ) {
             continue;
         }
 
-        register int nid = iinfo[ ind ].in_which_node;
-        TreeNode_t& nod = job.tree[nid];
+        // items of nodes out of layer are skipped.
+        uint32_t slot = (uint32_t)(iinfo[ ind ].in_which_node - beg_node);
+        if (slot >= node_count) {
+            continue;
+        }
+        NodeScan_t& nod = scan[slot];
 
         if (!si.same || nod.same_key!=same_key) { 
             update_try ++;
             nod.same_key = same_key;
             float temp_score = __mid_mse_score(
                     nod.temp_sum, nod.grow-nod.begin,
-                    nod.sum-nod.temp_sum, nod.end-nod.grow);
+                    nod.sum-nod.temp_sum, nod.begin+nod.cnt-nod.grow);
             if (temp_score > nod.score) {
                 update_cnt ++;
-                nod.fidx = job.feature_index;
+                nod.found = true;
                 nod.score = temp_score;
                 nod.split = nod.grow;
                 nod.split_id = ind;
@@ -263,70 +1050,666 @@ void* __worker_layer_processor(void* input) {
                 nod.split_ssum = nod.temp_ssum;
             }
         }
-        nod.temp_sum += iinfo[ind].residual;
-        nod.temp_ssum += iinfo[ind].residual * iinfo[ind].residual;
-        
-        dim_id_sorted[ nod.grow++ ] = ind;
+        float r = iinfo[ind].residual;
+        nod.temp_sum += r;
+        nod.temp_ssum += r * r;
+        nod.grow ++;
     } 
 
     t_calc.end();
     t_post.begin();
-
-    int update_node_counter = 0;
-    int update_node_set = 0;
-    for (int n=job.beg_node; n<job.end_node; ++n) {
-
-        TreeNode_t& node = job.tree[n];
-        node.fidx = job.feature_index;
-        node.end = node.grow;
-
-        if (node.cnt == 0) {
-            node.score = 0.0f;
-        } else {
-            // change score from middle-score to MSE.
-            node.score = (node.square_sum - node.score) / node.cnt;
-        }
-
-        if (master_tree[n] < job.tree[n]) {
-            // lock node.
-            job.locks[n].lock();
-            update_node_counter ++;
-
-            // update node and in_which_node info.
-            master_tree[n] = job.tree[n];
-
-            master_tree[_L(n)].init(node.begin, node.split);
-            master_tree[_L(n)].sum = node.split_sum;
-            master_tree[_L(n)].square_sum = node.split_ssum;
-
-            master_tree[_R(n)].init(node.split, node.end);
-            master_tree[_R(n)].sum = node.sum - node.split_sum;
-            master_tree[_R(n)].square_sum = node.square_sum - node.split_ssum;
-
-            // end lock.
-            job.locks[n].unlock();
-        }
-    }
+    int update_node_counter = __update_master_nodes(job, scan);
     t_post.end();
 
-    LOG_DEBUG("Feature %d tm=%.2fs [%.2f+%.2f] update_node: %d(set=%d) update=%d/%d", 
+    LOG_DEBUG("Feature %d tm=%.2fs [%.2f+%.2f] update_node: %d update=%d/%d", 
             job.feature_index, 
             t_calc.cost_time() + t_post.cost_time(),
             t_calc.cost_time(),
             t_post.cost_time(),
             update_node_counter,
-            update_node_set,
             update_cnt, update_try
             );
 
-    pthread_exit(0);
+    return NULL;
 }
 
-struct FeatureInfo_t {
-    int index;
-    float value;
-
-    bool operator < (const FeatureInfo_t& o) const {
+/*
+ * split candidate before value of present items in a node on a sparse feature,
+ * missing items go to either side, both are tried.
+ */
+inline void __missing_split_candidate(NodeScan_t& nod, float value) {
+    int left_present = nod.grow - nod.begin;
+    int right_present = nod.present_cnt - left_present;
+    int missing = nod.cnt - nod.present_cnt;
+    double missing_sum = nod.sum - nod.present_sum;
+
+    // missing items go right.
+    if (left_present > 0 && right_present + missing > 0) {
+        float temp_score = __mid_mse_score(
+                nod.temp_sum, left_present,
+                nod.sum - nod.temp_sum, right_present + missing);
+        if (temp_score > nod.score) {
+            nod.found = true;
+            nod.score = temp_score;
+            nod.split = nod.begin + left_present;
+            nod.split_id = THRESHOLD_READY_ID;
+            nod.split_present = left_present;
+            nod.threshold = value;
+            nod.default_left = false;
+
+            nod.split_sum = nod.temp_sum;
+            nod.split_ssum = nod.temp_ssum;
+        }
+    }
+    // missing items go left.
+    if (missing > 0 && right_present > 0) {
+        float temp_score = __mid_mse_score(
+                nod.temp_sum + missing_sum, left_present + missing,
+                nod.present_sum - nod.temp_sum, right_present);
+        if (temp_score > nod.score) {
+            nod.found = true;
+            nod.score = temp_score;
+            nod.split = nod.begin + left_present + missing;
+            nod.split_id = THRESHOLD_READY_ID;
+            nod.split_present = left_present;
+            nod.threshold = value;
+            nod.default_left = true;
+
+            nod.split_sum = nod.temp_sum + missing_sum;
+            nod.split_ssum = nod.temp_ssum + (nod.square_sum - nod.present_ssum);
+        }
+    }
+}
+
+/*
+ * __worker_layer_processor on a sparse feature.
+ *  only present items are stored and scanned, missing items of a node
+ *  are counted from node total minus present ones, and each split
+ *  learns which side they go (default_left).
+ */
+void* __worker_layer_processor_sparse(void* input) {
+    Timer t_calc, t_post;
+
+    Job_LayerFeatureProcess_t& job= *(Job_LayerFeatureProcess_t*)input;
+    if (!job.selected) {
+        return NULL;
+    }
+    const SparseColumn_t& col = *job.sparse;
+    ItemInfo_t* iinfo = job.iinfo;
+    int beg_node = job.beg_node;
+    uint32_t node_count = job.end_node - job.beg_node;
+
+    t_calc.begin();
+    NodeScan_t* scan = __layer_scan_init(job);
+
+    // present count and sums of each node.
+    for (uint32_t i=0; i<col.present; ++i) {
+        uint32_t ind = col.data[i].index;
+        if ( !ITEM_SAMPLE(ind) ) {
+            continue;
+        }
+        uint32_t slot = (uint32_t)(iinfo[ ind ].in_which_node - beg_node);
+        if (slot >= node_count) {
+            continue;
+        }
+        NodeScan_t& nod = scan[slot];
+        float r = iinfo[ind].residual;
+        nod.present_cnt ++;
+        nod.present_sum += r;
+        nod.present_ssum += r * r;
+    }
+
+    uint32_t same_key = INVALID_SAME_KEY;
+    for (uint32_t i=0; i<col.present; ++i) {
+        const SparseIndex_t& si = col.data[i];
+
+        if (i + _PREFETCH_STEP < col.present && ITEM_SAMPLE(col.data[i+_PREFETCH_STEP].index)) {
+            _mm_prefetch(iinfo + col.data[i+_PREFETCH_STEP].index, _PREFETCH_TYPE);
+        }
+
+        if (!si.same) { 
+            same_key = i;
+        }
+        uint32_t ind = si.index;
+        if ( !ITEM_SAMPLE(ind) ) {
+            continue;
+        }
+
+        uint32_t slot = (uint32_t)(iinfo[ ind ].in_which_node - beg_node);
+        if (slot >= node_count) {
+            continue;
+        }
+        NodeScan_t& nod = scan[slot];
+        if (!si.same || nod.same_key!=same_key) { 
+            nod.same_key = same_key;
+            __missing_split_candidate(nod, si.value);
+        }
+        float r = iinfo[ind].residual;
+        nod.temp_sum += r;
+        nod.temp_ssum += r * r;
+        nod.grow ++;
+    }
+
+    t_calc.end();
+    t_post.begin();
+    int update_node_counter = __update_master_nodes(job, scan);
+    t_post.end();
+
+    LOG_DEBUG("SparseFeature %d present=%u tm=%.2fs [%.2f+%.2f] update_node: %d", 
+            job.feature_index, col.present,
+            t_calc.cost_time() + t_post.cost_time(),
+            t_calc.cost_time(),
+            t_post.cost_time(),
+            update_node_counter);
+    return NULL;
+}
+
+/*
+ * layer job of one feature.
+ */
+void* __worker_layer_feature(void* input) {
+    const Job_LayerFeatureProcess_t& job = *(Job_LayerFeatureProcess_t*)input;
+    if (job.sparse) {
+        return __worker_layer_processor_sparse(input);
+    }
+    return __worker_layer_processor(input);
+}
+
+/*
+ * move items of nodes splitted on one feature to children.
+ *  items of a node are ranked in sorted order of the feature again,
+ *  the first (split - begin) go left, so partitions of the other
+ *  features are never kept. 
+ *  sparse feature: the first split_present present items go left,
+ *  missing items are moved afterwards.
+ */
+struct Job_LayerMove_t {
+    int feature_index;
+    int beg_node;
+    int end_node;
+    uint32_t item_count;
+    const SortedIndex_t* finfo;
+    const SparseColumn_t* sparse;
+    ItemInfo_t* iinfo;
+    const TreeNode_t* tree;
+};
+
+/*
+ * Index_t : SortedIndex_t or SparseIndex_t.
+ */
+template <typename Index_t>
+void __move_by_rank(const Index_t* col, uint32_t count, ItemInfo_t* iinfo, 
+        const TreeNode_t* tree, int beg_node, vector<int>& rank, const vector<int>& left) 
+{
+    uint32_t node_count = rank.size();
+    for (uint32_t i=0; i<count; ++i) {
+        if (i + _PREFETCH_STEP_POST < count) {
+            _mm_prefetch(iinfo + col[i+_PREFETCH_STEP_POST].index, _PREFETCH_TYPE);
+        }
+        uint32_t ind = col[i].index;
+        if ( !ITEM_SAMPLE(ind) ) {
+            continue;
+        }
+        uint32_t slot = (uint32_t)(iinfo[ ind ].in_which_node - beg_node);
+        if (slot >= node_count || rank[slot] < 0) {
+            continue;
+        }
+        int child = tree[beg_node + slot].left;
+        iinfo[ind].in_which_node = (rank[slot]++ < left[slot]) ? child : child + 1;
+    }
+}
+
+void* __worker_layer_move(void* input) {
+    Job_LayerMove_t& job = *(Job_LayerMove_t*)input;
+    ItemInfo_t* iinfo = job.iinfo;
+    int beg_node = job.beg_node;
+    uint32_t node_count = job.end_node - job.beg_node;
+
+    // rank[slot] < 0 : node is not splitted on this feature.
+    vector<int> rank(node_count, -1);
+    vector<int> left(node_count, 0);
+    for (uint32_t slot=0; slot<node_count; ++slot) {
+        const TreeNode_t& node = job.tree[beg_node + slot];
+        if (node.fidx == job.feature_index) {
+            rank[slot] = 0;
+            left[slot] = job.sparse ? node.split_present : (node.split - node.begin);
+        }
+    }
+
+    if (job.sparse) {
+        __move_by_rank(job.sparse->data, job.sparse->present, iinfo, job.tree, beg_node, rank, left);
+    } else {
+        __move_by_rank(job.finfo, job.item_count, iinfo, job.tree, beg_node, rank, left);
+    }
+    return NULL;
+}
+
+/*
+ * quantized column of one feature.
+ *  bin of each item is stored in uint8_t if the feature has no more than
+ *  256 bins, otherwise in uint16_t.
+ *  split_id[b] is the first item of bin b in sorted order.
+ */
+struct FeatureBins_t {
+    int bin_num;    // 0 : feature is not quantized (masked).
+    int width;      // bytes of each bin : 1 or 2.
+    void* data;
+    uint32_t* split_id;
+
+    FeatureBins_t():
+        bin_num(0),
+        width(1),
+        data(NULL),
+        split_id(NULL)
+    {}
+
+    ~FeatureBins_t() {
+        if (data) {
+            free(data);
+        }
+        if (split_id) {
+            delete [] split_id;
+        }
+    }
+
+    const uint8_t*  u8() const { return (const uint8_t*)data; }
+    const uint16_t* u16() const { return (const uint16_t*)data; }
+
+    int get(size_t i) const {
+        return (width == 1) ? u8()[i] : u16()[i];
+    }
+};
+
+/**
+ * histogram mode.
+ *  each feature is quantized into at most max_bin bins when init.
+ *  hist[slot][bin] keeps the residual sum and count of items in node
+ *  (slot = node - first node of this layer).
+ *  one child of a split node is scanned, its sibling is: parent - child.
+ *  rows of a node are kept contiguous in [node.begin, node.end) of the
+ *  row partition, with their residuals in the same order, so a node is
+ *  scanned by streaming its own rows instead of all items.
+ */
+struct HistBin_t {
+    double sum;
+    uint32_t cnt;
+};
+
+struct Job_LayerHistogram_t {
+    bool selected;
+    uint32_t item_count;
+    int feature_index;
+    int layer;
+    int beg_node;
+    int end_node;
+    int bin_num;
+
+    const FeatureBins_t* bins;
+    const uint32_t* rows;       // row partition: item id at each position.
+    const float* residual;      // residual of rows[i].
+
+    HistBin_t* hist;            // [1<<layer][bin_num]
+    const HistBin_t* parent_hist; // NULL if feature is not processed on last layer.
+    Lock_t lock;                // chunks of one node merge into hist under lock.
+
+    /*
+     * how each node in layer gets its histogram.
+     *  0 : node is not alive (parent is not splitted).
+     *  1 : scan items.
+     *  2 : parent - sibling.
+     */
+    char* how;
+
+    TreeNode_t*  master_tree;
+    Lock_t*      locks;
+};
+
+/*
+ * rows [begin, end) of one node (slot) in a feature.
+ * large nodes are cut into chunks, idle threads steal chunks of others.
+ */
+struct Job_HistogramChunk_t {
+    Job_LayerHistogram_t* job;
+    int slot;
+    bool whole;     // chunk is all rows of node.
+    uint32_t begin;
+    uint32_t end;
+};
+
+void __histogram_plan(Job_LayerHistogram_t& job) {
+    TreeNode_t* master_tree = job.master_tree;
+    for (int n=job.beg_node; n<job.end_node; ++n) {
+        char& h = job.how[n - job.beg_node];
+        if (n == 0) {
+            h = 1;
+            continue;
+        }
+        int p = (n-1) / 2;
+        if (master_tree[p].fidx < 0) {
+            h = 0;
+            continue;
+        }
+        h = 1;
+        if (job.parent_hist) {
+            int sibling = (n == _L(p)) ? _R(p) : _L(p);
+            // scan the smaller child, the larger one comes from subtraction.
+            if (master_tree[n].cnt > master_tree[sibling].cnt
+                    || (master_tree[n].cnt == master_tree[sibling].cnt && n == _R(p))) 
+            {
+                h = 2;
+            }
+        }
+    }
+    // scanned histograms are accumulated by chunks.
+    for (int n=job.beg_node; n<job.end_node; ++n) {
+        if (job.how[n - job.beg_node] == 1) {
+            memset(job.hist + (n - job.beg_node) * job.bin_num, 0, sizeof(HistBin_t) * job.bin_num);
+        }
+    }
+}
+
+/*
+ * rows are streamed with their residuals, only bins are gathered.
+ */
+template <typename Bin_t>
+void __histogram_scan(const Bin_t* bins, const uint32_t* rows, const float* residual, 
+        uint32_t begin, uint32_t end, HistBin_t* hist) 
+{
+    for (uint32_t i=begin; i<end; ++i) {
+        HistBin_t& b = hist[ bins[ rows[i] ] ];
+        b.sum += residual[i];
+        b.cnt ++;
+    }
+}
+
+void* __worker_histogram_chunk(void* input) {
+    Job_HistogramChunk_t& chunk = *(Job_HistogramChunk_t*)input;
+    Job_LayerHistogram_t& job = *chunk.job;
+
+    // slots are disjoint, only chunks of a cut node need the lock.
+    HistBin_t* slot_hist = job.hist + chunk.slot * job.bin_num;
+    HistBin_t* hist = slot_hist;
+    if (!chunk.whole) {
+        hist = new HistBin_t[job.bin_num];
+        memset(hist, 0, sizeof(HistBin_t) * job.bin_num);
+    }
+
+    if (job.bins->width == 1) {
+        __histogram_scan(job.bins->u8(), job.rows, job.residual, chunk.begin, chunk.end, hist);
+    } else {
+        __histogram_scan(job.bins->u16(), job.rows, job.residual, chunk.begin, chunk.end, hist);
+    }
+
+    if (chunk.whole) {
+        return NULL;
+    }
+    job.lock.lock();
+    for (int b=0; b<job.bin_num; ++b) {
+        slot_hist[b].sum += hist[b].sum;
+        slot_hist[b].cnt += hist[b].cnt;
+    }
+    job.lock.unlock();
+    delete [] hist;
+    return NULL;
+}
+
+/*
+ * rows of a splitted node are partitioned into its children, stable.
+ * rows going right are put aside in row_buffer first.
+ */
+struct Job_HistogramPartition_t {
+    TreeNode_t* tree;
+    int node;
+    const FeatureBins_t* bins;
+
+    uint32_t* rows;
+    float* residual;
+    uint32_t* row_buffer;
+    float* residual_buffer;
+};
+
+template <typename Bin_t>
+void __histogram_partition(Job_HistogramPartition_t& job, const Bin_t* bins) {
+    TreeNode_t& node = job.tree[job.node];
+    uint32_t left = node.begin;
+    uint32_t right = node.begin;
+    double left_ssum = 0;
+    double right_ssum = 0;
+    for (int i=node.begin; i<node.end; ++i) {
+        uint32_t row = job.rows[i];
+        float r = job.residual[i];
+        if (bins[row] <= node.split_bin) {
+            job.rows[left] = row;
+            job.residual[left] = r;
+            left ++;
+            left_ssum += r * r;
+        } else {
+            job.row_buffer[right] = row;
+            job.residual_buffer[right] = r;
+            right ++;
+            right_ssum += r * r;
+        }
+    }
+    memcpy(job.rows + left, job.row_buffer + node.begin, sizeof(uint32_t) * (right - node.begin));
+    memcpy(job.residual + left, job.residual_buffer + node.begin, sizeof(float) * (right - node.begin));
+    job.tree[node.left].square_sum = left_ssum;
+    job.tree[node.left + 1].square_sum = right_ssum;
+}
+
+void* __worker_histogram_partition(void* input) {
+    Job_HistogramPartition_t& job = *(Job_HistogramPartition_t*)input;
+    if (job.bins->width == 1) {
+        __histogram_partition(job, job.bins->u8());
+    } else {
+        __histogram_partition(job, job.bins->u16());
+    }
+    return NULL;
+}
+
+/*
+ * histograms of scanned nodes are ready.
+ * make up the others by subtraction and find best split of each node.
+ */
+void* __worker_layer_histogram(void* input) {
+    Job_LayerHistogram_t& job = *(Job_LayerHistogram_t*)input;
+    if (!job.selected) {
+        return NULL;
+    }
+
+    Timer t_calc, t_post;
+    t_calc.begin();
+
+    int node_count = job.end_node - job.beg_node;
+    int bin_num = job.bin_num;
+    const char* how = job.how;
+    TreeNode_t* master_tree = job.master_tree;
+
+    int parent_beg = (job.layer>0) ? ((1<<(job.layer-1)) - 1) : 0;
+    for (int n=job.beg_node; n<job.end_node; ++n) {
+        int slot = n - job.beg_node;
+        if (how[slot] != 2) {
+            continue;
+        }
+        int p = (n-1) / 2;
+        int sibling = (n == _L(p)) ? _R(p) : _L(p);
+        const HistBin_t* ph = job.parent_hist + (p - parent_beg) * bin_num;
+        const HistBin_t* sh = job.hist + (sibling - job.beg_node) * bin_num;
+        HistBin_t* h = job.hist + slot * bin_num;
+        for (int b=0; b<bin_num; ++b) {
+            h[b].sum = ph[b].sum - sh[b].sum;
+            h[b].cnt = ph[b].cnt - sh[b].cnt;
+        }
+    }
+    t_calc.end();
+    t_post.begin();
+
+    // find best split on each node.
+    int update_node_counter = 0;
+    for (int n=job.beg_node; n<job.end_node; ++n) {
+        int slot = n - job.beg_node;
+        if (how[slot] == 0) {
+            continue;
+        }
+        TreeNode_t node = master_tree[n];
+        if (node.cnt <= 1) {
+            continue;
+        }
+        float best_score = __mid_mse_score(0, 0, node.sum, node.cnt);
+        int best_bin = -1;
+        double best_sum = 0;
+        int best_cnt = 0;
+
+        const HistBin_t* h = job.hist + slot * bin_num;
+        double left_sum = 0;
+        int left_cnt = 0;
+        for (int b=0; b<bin_num-1; ++b) {
+            left_sum += h[b].sum;
+            left_cnt += h[b].cnt;
+            if (h[b].cnt == 0 || left_cnt == 0 || left_cnt >= node.cnt) {
+                continue;
+            }
+            float temp_score = __mid_mse_score(
+                    left_sum, left_cnt,
+                    node.sum - left_sum, node.cnt - left_cnt);
+            if (temp_score > best_score) {
+                best_score = temp_score;
+                best_bin = b;
+                best_sum = left_sum;
+                best_cnt = left_cnt;
+            }
+        }
+        if (best_bin < 0) {
+            continue;
+        }
+
+        node.fidx = job.feature_index;
+        node.score = (node.square_sum - best_score) / node.cnt;
+        node.split_bin = best_bin;
+        node.split_id = job.bins->split_id[best_bin + 1];
+        node.split = node.begin + best_cnt;
+        node.split_sum = best_sum;
+
+        if (master_tree[n] < node) {
+            job.locks[n].lock();
+            if (master_tree[n] < node) {
+                update_node_counter ++;
+                master_tree[n] = node;
+                master_tree[n].left = _L(n);
+
+                // square_sum of children is calculated when items are moved.
+                master_tree[_L(n)].init(node.begin, node.split);
+                master_tree[_L(n)].sum = node.split_sum;
+                master_tree[_L(n)].square_sum = 0;
+
+                master_tree[_R(n)].init(node.split, node.end);
+                master_tree[_R(n)].sum = node.sum - node.split_sum;
+                master_tree[_R(n)].square_sum = 0;
+            }
+            job.locks[n].unlock();
+        }
+    }
+    t_post.end();
+
+    LOG_DEBUG("Feature %d tm=%.2fs [%.2f+%.2f] update_node: %d", 
+            job.feature_index, 
+            t_calc.cost_time() + t_post.cost_time(),
+            t_calc.cost_time(),
+            t_post.cost_time(),
+            update_node_counter);
+    return NULL;
+}
+
+struct __GBDTBinJob_t {
+    int fid;
+    FILE* sorted_index_fd;
+    bool sparse;        // fd is a SparseColumn_t.
+    size_t count;
+    int max_bin;
+
+    FeatureBins_t* bins;
+};
+
+/*
+ * return bin count.
+ *  each value has its own bin if diff_value<=max_bin,
+ *  otherwise values are merged into bins with similar item count.
+ */
+template <typename Bin_t>
+int __quantize_sorted_index(const SortedIndex_t* finfo, size_t count, size_t diff_value, 
+        int max_bin, Bin_t* bins, uint32_t* split_id) 
+{
+    bool exact = (diff_value <= (size_t)max_bin);
+    int cur_bin = 0;
+    size_t cur_cnt = 0;
+    size_t target = (count + max_bin - 1) / max_bin;
+    for (size_t i=0; i<count; ++i) {
+        const SortedIndex_t& si = finfo[i];
+        if (i == 0) {
+            split_id[0] = si.index;
+        } else if (!si.same && (exact || (cur_cnt >= target && cur_bin+1 < max_bin))) {
+            cur_bin ++;
+            cur_cnt = 0;
+            split_id[cur_bin] = si.index;
+            // spread the remaining items on the remaining bins.
+            target = (count - i + (max_bin - cur_bin) - 1) / (max_bin - cur_bin);
+        }
+        bins[si.index] = cur_bin;
+        cur_cnt ++;
+    }
+    return cur_bin + 1;
+}
+
+/*
+ * quantize one feature by its sorted index file.
+ *  items with same value are always in the same bin.
+ *  the sorted index is only kept in memory during quantization.
+ */
+void* __quantize_feature(void* con) {
+    __GBDTBinJob_t& job = *(__GBDTBinJob_t*)con;
+    SortedIndex_t* finfo = new SortedIndex_t[job.count];
+    if (job.sparse) {
+        SparseColumn_t col;
+        col.read(job.sorted_index_fd);
+        col.expand(finfo, job.count);
+    } else {
+        fseek(job.sorted_index_fd, 0, SEEK_SET);
+        fread(finfo, job.count, sizeof(SortedIndex_t), job.sorted_index_fd);
+    }
+
+    size_t diff_value = 0;
+    for (size_t i=0; i<job.count; ++i) {
+        if (!finfo[i].same) {
+            diff_value ++;
+        }
+    }
+    int bin_num = job.max_bin;
+    if (diff_value < (size_t)bin_num) {
+        bin_num = (int)diff_value;
+    }
+
+    FeatureBins_t& fb = *job.bins;
+    fb.width = (bin_num <= 256) ? 1 : 2;
+    fb.data = malloc(fb.width * job.count);
+    fb.split_id = new uint32_t[bin_num];
+    if (fb.width == 1) {
+        fb.bin_num = __quantize_sorted_index(finfo, job.count, diff_value, bin_num, 
+                (uint8_t*)fb.data, fb.split_id);
+    } else {
+        fb.bin_num = __quantize_sorted_index(finfo, job.count, diff_value, bin_num, 
+                (uint16_t*)fb.data, fb.split_id);
+    }
+    delete [] finfo;
+
+    LOG_DEBUG("quantize feature %d : diff_value=%lu bin_num=%d width=%d", 
+            job.fid, diff_value, fb.bin_num, fb.width);
+    return NULL;
+}
+
+struct FeatureInfo_t {
+    int index;
+    float value;
+
+    bool operator < (const FeatureInfo_t& o) const {
         if (value == o.value) {
             // magic: ..why reversed order..
             return index > o.index;
@@ -335,17 +1718,61 @@ struct FeatureInfo_t {
     }
 };
 
-struct __GBDTPreprocessSortJob_t {
+struct __FeatureValueKey_t {
+    float operator() (const FeatureInfo_t& f) const { return f.value; }
+};
+
+/*
+ * radix sort a part of one feature column.
+ * indices of a part are filled in ascending order, so reversed ties give
+ * the same order as FeatureInfo_t::operator <.
+ */
+void __radix_sort_feature_part(FeatureInfo_t* begin, FeatureInfo_t* end, FeatureInfo_t* buffer) {
+    radix_sort_float(begin, end - begin, buffer, __FeatureValueKey_t(), true);
+}
+
+/*
+ * present values of a sparse feature in item order.
+ * they are sorted and written to path, fd is opened on it for reading.
+ */
+struct __GBDTSparseJob_t {
     int fid;
-    FeatureInfo_t* ptr;
-    size_t count;
+    uint32_t present;
+    FeatureInfo_t* list;
+    char path[256];
+    FILE* fd;
 };
 
-void* __sorted_feature_index(void* con) {
-    __GBDTPreprocessSortJob_t& job = *(__GBDTPreprocessSortJob_t*)con;
-    LOG_NOTICE("sort dim : %d", job.fid);
-    sort(job.ptr, job.ptr+job.count);
-    LOG_NOTICE("sort dim %d over.", job.fid);
+void* __sort_sparse_feature(void* con) {
+    __GBDTSparseJob_t& job = *(__GBDTSparseJob_t*)con;
+    if (job.present > 0) {
+        FeatureInfo_t* buffer = new FeatureInfo_t[job.present];
+        __radix_sort_feature_part(job.list, job.list + job.present, buffer);
+        delete [] buffer;
+    }
+
+    SparseColumn_t col;
+    col.present = job.present;
+    col.data = new SparseIndex_t[job.present];
+    for (uint32_t i=0; i<job.present; ++i) {
+        const FeatureInfo_t& f = job.list[i];
+        col.data[i].index = f.index;
+        col.data[i].value = f.value;
+        col.data[i].same = (i>0 && f.value == job.list[i-1].value) ? 1 : 0;
+        if (f.value < 0) {
+            col.neg = i + 1;
+        }
+    }
+
+    FILE* fout = fopen(job.path, "wb");
+    if (!fout) {
+        LOG_ERROR("open temp directory to save field information failed! [%s]", job.path);
+        exit(-1);
+    }
+    col.write(fout);
+    fclose(fout);
+    job.fd = fopen(job.path, "rb");
+    LOG_DEBUG("write sparse feature file over [%s] present=%u neg=%u", job.path, col.present, col.neg);
     return NULL;
 }
 
@@ -365,14 +1792,26 @@ class GBDT_t
 
     public:
         GBDT_t(const Config_t& config, const char* section):
+            _pool(NULL),
             _trees(NULL),
             _ffd(NULL),
             _sorted_fields(NULL),
+            _sparse_fields(NULL),
+            _is_sparse(NULL),
+            _bins(NULL),
+            _hist(NULL),
+            _hist_stamp(NULL),
+            _rows(NULL),
+            _row_residual(NULL),
+            _row_buffer(NULL),
+            _residual_buffer(NULL),
             _compact_trees(NULL),
             _mean(NULL),
             _feature_weight(NULL),
             _output_feature_weight(false),
-            _predict_tree_cut(-1)
+            _predict_tree_cut(-1),
+            _predict_method(PM_Tree),
+            _simd_isa(-1)
         {
             _sample_feature = config.conf_float_default(section, "sample_feature", 1.0);
             _sample_instance = config.conf_float_default(section, "sample_instance", 1.0);
@@ -395,12 +1834,72 @@ class GBDT_t
             _temp_dir = config.conf_str_default(section, "temp_dir", "gbdt_temp");
             LOG_NOTICE("_temp_dir=%s", _temp_dir.c_str());
 
+            // features present in no more than sparse_ratio of items keep only
+            // present values, the others are missing. 0 : all features are dense.
+            _sparse_ratio = config.conf_float_default(section, "sparse_ratio", 0.25);
+            LOG_NOTICE("_sparse_ratio=%.3f", _sparse_ratio);
+
             _load_cache = config.conf_int_default(section, "load_cache", 0);
             LOG_NOTICE("_load_cache=%d", _load_cache);
 
             _save_model_epoch = config.conf_int_default(section, "save_model_epoch", -1);
             LOG_NOTICE("_save_model_epoch=%d", _save_model_epoch);
 
+            string method = config.conf_str_default(section, "split_method", "sorted");
+            const char* split_method_str[] = {"sorted", "histogram"};
+            if (method == "sorted") {
+                _split_method = SM_Sorted;
+            } else if (method == "histogram") {
+                _split_method = SM_Histogram;
+            } else {
+                LOG_ERROR("Illegal split method: %s", method.c_str());
+                _split_method = SM_Sorted;
+            }
+            LOG_NOTICE("split_method=%s", split_method_str[_split_method]);
+
+            // features with more than 256 bins are stored in uint16_t.
+            _max_bin = config.conf_int_default(section, "max_bin", 256);
+            if (_max_bin > 65536) {
+                LOG_ERROR("max_bin=%d is too large, use 65536 instead.", _max_bin);
+                _max_bin = 65536;
+            }
+            if (_max_bin < 2) {
+                _max_bin = 2;
+            }
+            LOG_NOTICE("max_bin=%d", _max_bin);
+
+            // items of a feature are scanned in chunks of this size.
+            _histogram_chunk_size = config.conf_int_default(section, "histogram_chunk_size", 1<<20);
+            if (_histogram_chunk_size < 1024) {
+                _histogram_chunk_size = 1024;
+            }
+            LOG_NOTICE("histogram_chunk_size=%u", _histogram_chunk_size);
+
+            // >0 : trees grow best-first to max_leaves leaves, layer_num is ignored.
+            // node id of item is unsigned short, so 2*max_leaves nodes fit in it.
+            _max_leaves = config.conf_int_default(section, "max_leaves", 0);
+            if (_max_leaves > 32767) {
+                LOG_ERROR("max_leaves=%d is too large, use 32767 instead.", _max_leaves);
+                _max_leaves = 32767;
+            }
+            if (_max_leaves > 0 && _split_method == SM_Histogram) {
+                LOG_ERROR("max_leaves is supported by sorted split_method only, grow layer by layer.");
+                _max_leaves = 0;
+            }
+            LOG_NOTICE("max_leaves=%d", _max_leaves);
+
+            // predict_method is applied when model is loaded or trained.
+            string predict_method = config.conf_str_default(section, "predict_method", "tree");
+            const char* predict_method_str[] = {"tree", "quickscorer", "simd"};
+            if (predict_method == "quickscorer") {
+                _predict_method = PM_QuickScorer;
+            } else if (predict_method == "simd") {
+                _predict_method = PM_Simd;
+            } else if (predict_method != "tree") {
+                LOG_ERROR("Illegal predict method: %s", predict_method.c_str());
+            }
+            LOG_NOTICE("predict_method=%s", predict_method_str[_predict_method]);
+
             string s = config.conf_str_default(section, "feature_mask", "");
             vector<string> vs;
             split((char*)s.c_str(), ",", vs);
@@ -412,12 +1911,19 @@ class GBDT_t
             }
 
             _tree_size = 1 << (_max_layer + 2);
+            if (_max_leaves > 0) {
+                _tree_size = _max_leaves * 2;
+            }
 
             _labels = NULL;
         }
 
         virtual ~GBDT_t() {
             LOG_NOTICE("Destroy work for GBDT begins.");
+            if (_pool) {
+                delete _pool;
+                _pool = NULL;
+            }
             if (_feature_weight) {
                 delete [] _feature_weight;
                 _feature_weight = NULL;
@@ -464,6 +1970,15 @@ class GBDT_t
                 delete [] _sorted_fields;
                 _sorted_fields = NULL;
             }
+            if (_sparse_fields) {
+                delete [] _sparse_fields;
+                _sparse_fields = NULL;
+            }
+            if (_is_sparse) {
+                delete [] _is_sparse;
+                _is_sparse = NULL;
+            }
+            _release_bins();
 
             LOG_NOTICE("Destroy work for GBDT ends");
         }
@@ -472,6 +1987,16 @@ class GBDT_t
             _predict_tree_cut = N;
         }
 
+        /*
+         * select evaluator of loaded or trained trees.
+         *  simd_isa : SimdScorer_t::Isa_t of PM_Simd, -1 : chosen by cpu.
+         */
+        void set_predict_method(GBDTPredictMethod_t method, int simd_isa=-1) {
+            _predict_method = method;
+            _simd_isa = simd_isa;
+            _build_predictor();
+        }
+
         int get_predict_tree_cut() const {
             if (_predict_tree_cut == -1) {
                 return _tree_count;
@@ -497,13 +2022,35 @@ class GBDT_t
                 predict_buffer = new float[_dim_count];
             }
 
-            memset(predict_buffer, 0, sizeof(float) * _dim_count);
+            // missing features are NaN, they go to default direction of node.
+            float missing = std::numeric_limits<float>::quiet_NaN();
+            for (int i=0; i<_dim_count; ++i) {
+                predict_buffer[i] = missing;
+            }
             for (size_t f=0; f<ins.features.size(); ++f) {
                 if (ins.features[f].index < _dim_count) {
                     predict_buffer[ins.features[f].index] = ins.features[f].value;
                 }
             }
 
+            if (_predict_method == PM_QuickScorer && _quick_scorer.tree_count() == _tree_count) {
+                uint64_t* masks = new uint64_t[_tree_count];
+                ret = _quick_scorer.score(predict_buffer, min(get_predict_tree_cut(), _tree_count), masks,
+                        output_leaf_id_in_each_tree, output_mean);
+                delete [] masks;
+                if (!buffer) {
+                    delete [] predict_buffer;
+                }
+                return ret;
+            }
+            if (output_leaf_id_in_each_tree == NULL && _packed_forest.tree_count() == _tree_count) {
+                ret = _packed_forest.score(predict_buffer, min(get_predict_tree_cut(), _tree_count));
+                if (!buffer) {
+                    delete [] predict_buffer;
+                }
+                return ret;
+            }
+
             SmallTreeNode_t** end_tree = _compact_trees + _tree_count;
 
             int tc = 0;
@@ -516,8 +2063,9 @@ class GBDT_t
                 while (1) {
                     SmallTreeNode_t* node = (*tree)+nid;
                     if (node->fidx != -1) {
-                        nid = _L(nid);
-                        if (predict_buffer[node->fidx] >= node->threshold) {
+                        nid = node->left;
+                        float v = predict_buffer[node->fidx];
+                        if (v >= node->threshold || (v != v && !node->default_left)) {
                             nid ++;
                         }
                     } else {
@@ -532,19 +2080,111 @@ class GBDT_t
                 }
                 ret += _mean[tree - _compact_trees][nid];
 
-                tc++;
+                tc++;
+            }
+            if (!buffer) {
+                delete [] predict_buffer;
+            }
+            return ret;
+        }
+
+
+        /*
+         * rows are densified in blocks, each tree is walked for the whole
+         * block before the next tree, so nodes of a tree stay in cache.
+         *  features of a block are set back to NaN after use, so the dense
+         *  buffer is filled only once per call.
+         */
+        virtual void predict_batch(const InstanceBatch_t& rows, size_t n, float* out) const {
+            size_t block = predict_block_size();
+            float missing = std::numeric_limits<float>::quiet_NaN();
+            float* buffer = new float[block * _dim_count];
+            for (size_t i=0; i<block * _dim_count; ++i) {
+                buffer[i] = missing;
+            }
+
+            int tree_count = get_predict_tree_cut();
+            if (tree_count > _tree_count) {
+                tree_count = _tree_count;
+            }
+            uint64_t* masks = NULL;
+            int qs_rows = 0;
+            bool simd = (_predict_method == PM_Simd && _simd_scorer.tree_count() == _tree_count);
+            bool packed = (_packed_forest.tree_count() == _tree_count);
+            if (_predict_method == PM_QuickScorer && _quick_scorer.tree_count() == _tree_count) {
+                qs_rows = _quick_scorer.block_rows();
+                masks = new uint64_t[qs_rows * _tree_count];
+            }
+            for (size_t begin=0; begin<n; begin+=block) {
+                size_t end = begin + block;
+                if (end > n) {
+                    end = n;
+                }
+                for (size_t r=begin; r<end; ++r) {
+                    float* values = buffer + (r - begin) * _dim_count;
+                    const IndValue_t* f = rows.features(r);
+                    for (size_t k=0; k<rows.feature_num(r); ++k) {
+                        if (f[k].index < _dim_count) {
+                            values[f[k].index] = f[k].value;
+                        }
+                    }
+                    out[r] = 0.0f;
+                }
+
+                if (masks) {
+                    for (size_t r=begin; r<end; r+=qs_rows) {
+                        int rows = (r + qs_rows < end) ? qs_rows : (end - r);
+                        _quick_scorer.score_block(buffer + (r - begin) * _dim_count, _dim_count, 
+                                rows, tree_count, masks, out + r);
+                    }
+                } else if (simd) {
+                    _simd_scorer.score_block(buffer, _dim_count, end - begin, tree_count, out + begin);
+                } else if (packed) {
+                    _packed_forest.score_block(buffer, _dim_count, end - begin, tree_count, out + begin);
+                } else {
+                    _walk_block(buffer, end - begin, tree_count, out + begin);
+                }
+
+                for (size_t r=begin; r<end; ++r) {
+                    float* values = buffer + (r - begin) * _dim_count;
+                    const IndValue_t* f = rows.features(r);
+                    for (size_t k=0; k<rows.feature_num(r); ++k) {
+                        if (f[k].index < _dim_count) {
+                            values[f[k].index] = missing;
+                        }
+                    }
+                }
+            }
+            if (masks) {
+                delete [] masks;
+            }
+            delete [] buffer;
+        }
+
+        /*
+         * rows of a block in predict_batch(), dense block is about 1MB.
+         */
+        size_t predict_block_size() const {
+            size_t block = (1 << 18) / (_dim_count > 0 ? _dim_count : 1);
+            if (block < 1) {
+                block = 1;
             }
-            if (!buffer) {
-                delete [] predict_buffer;
+            if (block > 256) {
+                block = 256;
             }
-            return ret;
+            return block;
         }
 
+        // size of buffer used by predict_and_get_leaves().
+        int dim() const { return _dim_count; }
 
         virtual void write_model(FILE* stream) const {
+            int tag = GBDT_MODEL_TAG_CHILD_INDEX;
+            fwrite(&tag, 1, sizeof(tag), stream);
             fwrite(&_tree_count, 1, sizeof(_tree_count), stream);
             fwrite(&_tree_size, 1, sizeof(_tree_size), stream);
             fwrite(&_sr, 1, sizeof(_sr), stream);
+            fwrite(&_max_leaves, 1, sizeof(_max_leaves), stream);
 
             for (int T=0; T<_tree_count; ++T) {
                 for (int i=0; i<_tree_size; ++i) {
@@ -555,9 +2195,12 @@ class GBDT_t
         }
 
         virtual void write_model_epoch(FILE* stream, int tree_count) const {
+            int tag = GBDT_MODEL_TAG_CHILD_INDEX;
+            fwrite(&tag, 1, sizeof(tag), stream);
             fwrite(&tree_count, 1, sizeof(tree_count), stream);
             fwrite(&_tree_size, 1, sizeof(_tree_size), stream);
             fwrite(&_sr, 1, sizeof(_sr), stream);
+            fwrite(&_max_leaves, 1, sizeof(_max_leaves), stream);
 
             for (int T=0; T<tree_count; ++T) {
                 for (int i=0; i<_tree_size; ++i) {
@@ -574,9 +2217,24 @@ class GBDT_t
                 return;
             }
             fread(&_tree_count, 1, sizeof(_tree_count), stream);
+            bool with_default = false;
+            bool with_child = false;
+            if (_tree_count == GBDT_MODEL_TAG_DEFAULT_DIRECTION) {
+                with_default = true;
+                fread(&_tree_count, 1, sizeof(_tree_count), stream);
+            } else if (_tree_count == GBDT_MODEL_TAG_CHILD_INDEX) {
+                with_default = true;
+                with_child = true;
+                fread(&_tree_count, 1, sizeof(_tree_count), stream);
+            }
             fread(&_tree_size, 1, sizeof(_tree_size), stream);
             fread(&_sr, 1, sizeof(_sr), stream);
-            LOG_NOTICE("LOADING_INFO: _tree_count=%d _tree_size=%d _sr=%f", _tree_count, _tree_size, _sr);
+            _max_leaves = 0;
+            if (with_child) {
+                fread(&_max_leaves, 1, sizeof(_max_leaves), stream);
+            }
+            LOG_NOTICE("LOADING_INFO: _tree_count=%d _tree_size=%d _sr=%f max_leaves=%d", 
+                    _tree_count, _tree_size, _sr, _max_leaves);
             _max_layer = 0;
             size_t t =_tree_size;
             while (t) {
@@ -594,7 +2252,10 @@ class GBDT_t
                 _compact_trees[T] = new SmallTreeNode_t[_tree_size];
                 _mean[T] = new float[_tree_size];
                 for (int i=0; i<_tree_size; ++i) {
-                    temp_node.read(stream);
+                    temp_node.read(stream, with_default, with_child);
+                    if (!with_child) {
+                        temp_node.left = _L(i);
+                    }
                     _compact_trees[T][i].copy(temp_node);
                     _mean[T][i] = temp_node.mean * _sr;
                     if (_dim_count <= _compact_trees[T][i].fidx) {
@@ -602,14 +2263,65 @@ class GBDT_t
                     }
                 }
             }
+            _build_predictor();
             return ;
         }
 
+        /*
+         * write model as C++ source of nested comparisons, thresholds and
+         * leaf values are constants. exported functions are loaded by
+         * CompiledGBDT_t:
+         *  int   fly_gbdt_dim();
+         *  int   fly_gbdt_tree_count();
+         *  float fly_gbdt_predict(const float* values, int tree_count);
+         *  void  fly_gbdt_predict_batch(const float* values, int stride, int rows,
+         *          int tree_count, float* out);
+         *  values are dense, missing features are NaN.
+         *  scores are the same as predict() bit by bit, if built without -ffast-math.
+         */
+        void write_code(FILE* stream) const {
+            fprintf(stream, "// GBDT model compiled by fly: trees=%d dim=%d.\n", _tree_count, _dim_count);
+            fprintf(stream, "//  build: g++ -O2 -shared -fPIC -o <model>.so <model>.cc\n\n");
+            for (int T=0; T<_tree_count; ++T) {
+                fprintf(stream, "static float tree_%d(const float* v) {\n", T);
+                _write_code_node(stream, T, 0, 1);
+                fprintf(stream, "}\n\n");
+            }
+
+            fprintf(stream, "extern \"C\" {\n\n");
+            fprintf(stream, "int fly_gbdt_dim() { return %d; }\n\n", _dim_count);
+            fprintf(stream, "int fly_gbdt_tree_count() { return %d; }\n\n", _tree_count);
+
+            // trees are summed in order, as predict() does.
+            fprintf(stream, "float fly_gbdt_predict(const float* v, int n) {\n");
+            fprintf(stream, "    float s = 0.0f;\n");
+            for (int T=0; T<_tree_count; ++T) {
+                fprintf(stream, "    if (n <= %d) return s;\n", T);
+                fprintf(stream, "    s += tree_%d(v);\n", T);
+            }
+            fprintf(stream, "    return s;\n}\n\n");
+
+            // tree by tree for all rows, code of a tree stays in cache.
+            fprintf(stream, "void fly_gbdt_predict_batch(const float* v, int stride, int rows, int n, float* out) {\n");
+            fprintf(stream, "    for (int r=0; r<rows; ++r) out[r] = 0.0f;\n");
+            for (int T=0; T<_tree_count; ++T) {
+                fprintf(stream, "    if (n <= %d) return;\n", T);
+                fprintf(stream, "    for (int r=0; r<rows; ++r) out[r] += tree_%d(v + (long)r * stride);\n", T);
+            }
+            fprintf(stream, "}\n\n");
+            fprintf(stream, "}\n");
+        }
+
         virtual void  init(IReader_t* reader) {
             // construct column infomation.
             _reader = reader;
             _item_count = (unsigned)reader->size();
 
+            // threads are reused by preprocessing and every layer of training.
+            if (_pool == NULL) {
+                _pool = new ThreadPool_t(_thread_num);
+            }
+
             _dim_count = reader->dim();
             if (_feature_weight) {
                 delete [] _feature_weight;
@@ -619,21 +2331,28 @@ class GBDT_t
 
             _labels = new ItemInfo_t[_item_count];
             _ffd = new FILE*[_dim_count];
+            _is_sparse = new bool[_dim_count];
+            memset(_is_sparse, 0, sizeof(bool)*_dim_count);
             if (_load_cache) { 
                 LOG_NOTICE("Load feature cache from dir..[%s]", _temp_dir.c_str());
                 for (int fid=0; fid<_dim_count; ++fid) {
-                    char buf[32];
+                    char buf[256];
                     snprintf(buf, sizeof(buf), "%s/feature.%d", _temp_dir.c_str(), fid);
                     _ffd[fid] = fopen(buf, "r");
+                    if (_ffd[fid] == NULL) {
+                        snprintf(buf, sizeof(buf), "%s/sparse.%d", _temp_dir.c_str(), fid);
+                        _ffd[fid] = fopen(buf, "r");
+                        _is_sparse[fid] = true;
+                    }
                     if (_ffd[fid] == NULL) {
                         LOG_ERROR("Cannot open file [%s] to write index info.");
                         throw std::runtime_error(_temp_dir);
                     }
                 }
-                Instance_t item;
+                InstanceView_t item;
                 size_t item_id = 0;
                 int cur_per = 0;
-                while (reader->read(&item)) {
+                while (reader->read_view(&item)) {
                     _labels[item_id].residual = item.label;
                     item_id ++;
 
@@ -646,129 +2365,64 @@ class GBDT_t
                 fprintf(stderr, "\n");
 
             } else { // save to _feature_output_dir
-                
-                size_t preprocess_memory_each_feature = sizeof(FeatureInfo_t) * _item_count;
-                size_t maximum_memory = _preprocess_maximum_memory * (1<<30);
-                int epoch_count = (maximum_memory - 2*sizeof(SortedIndex_t)*_item_count) / preprocess_memory_each_feature;
-                if (epoch_count > _dim_count) {
-                    epoch_count = _dim_count;
-                }
-                LOG_NOTICE("Preprocess: MemoryLimit=%dg EachFeatureRequired=%.2fg EpochCount=%d",
-                        _preprocess_maximum_memory,
-                        preprocess_memory_each_feature * 1. / (1<<30),
-                        epoch_count);
-
                 // clear temp_dir.
                 system( (string("rm -rf ") + _temp_dir).c_str() );
                 system( (string("mkdir ") + _temp_dir).c_str() );
 
-                FeatureInfo_t **ptr = new FeatureInfo_t*[epoch_count];
-                for (int i=0; i<epoch_count; ++i) {
-                    ptr[i] = new FeatureInfo_t[_item_count];
-                }
-                SortedIndex_t *idx_list = new SortedIndex_t[_item_count];
-
-                for (int feature_begin=0; feature_begin<_dim_count; feature_begin += epoch_count) {
-                    LOG_NOTICE("Preproces epoch : feature_range=[%d, %d)", feature_begin, feature_begin + epoch_count );
-                    Instance_t item;
-                    size_t item_id = 0;
-                    int cur_per = 0;
-                    int feature_count = epoch_count;
-                    if (feature_begin + epoch_count > _dim_count) {
-                        feature_count = _dim_count - feature_begin;
-                    }
-
-                    reader->reset();
-                    while (reader->read(&item/*, true*/)) {
-                        _labels[item_id].residual = item.label;
-
-                        // some feature may be missing.
-                        // default value set to zero.
-                        for (int i=0; i<epoch_count; ++i) {
-                            ptr[i][item_id].index = item_id;
-                            ptr[i][item_id].value = 0;
-                        }
-                        for (size_t i=0; i<item.features.size(); ++i) {
-                            const IndValue_t& f = item.features[i];
-                            int f_offset = f.index - feature_begin;
-                            if (f_offset<0 || f_offset>=epoch_count) {
-                                continue;
-                            }
-                            ptr[f_offset][item_id].value = f.value;
-                        }
-                        item_id ++;
-
-                        int per = reader->percentage();
-                        if (per > cur_per) {
-                            cur_per = per;
-                            fprintf(stderr, "%c%4d%% loaded..", 13, cur_per);
-                        }
-                    }
-                    fprintf(stderr, "\n");
-
-                    __GBDTPreprocessSortJob_t* jobs = new __GBDTPreprocessSortJob_t[feature_count];
-                    for (int i=0; i<feature_count; ++i) {
-                        jobs[i].fid = feature_begin + i;
-                        jobs[i].ptr = ptr[i];
-                        jobs[i].count = _item_count;
+                // labels and present count of features.
+                vector<uint32_t> present(_dim_count, 0);
+                const DenseDataset_t* dense = reader->dense_data();
+                if (dense) {
+                    for (size_t i=0; i<_item_count; ++i) {
+                        _labels[i].residual = dense->label(i);
                     }
-                    multi_thread_jobs(__sorted_feature_index, jobs, feature_count, feature_count);
-                    delete [] jobs;
-
-                    for (int offset=0; offset<epoch_count; ++offset) {
-                        int fid = offset + feature_begin;
-                        if (fid >= _dim_count) {
-                            break;
-                        }
-
-
-                        // set is_same flag.
-                        // if set, continuous item has same value(Cannot be splited)
-                        size_t diff_value = 0;
-                        for (size_t i=0; i<_item_count; ++i) {
-                            idx_list[i].index = ptr[offset][i].index;
-                            if (i>0 && ptr[offset][i].value == ptr[offset][i-1].value) {
-                                idx_list[i].same = 1;
-                            } else {
-                                idx_list[i].same = 0;
-                                diff_value ++;
-                            }
-                        }
-                        LOG_NOTICE("check same info feature=[%d] diff_value=%u over.", fid, diff_value);
-
-                        char buf[32];
-                        snprintf(buf, sizeof(buf), "%s/feature.%d", _temp_dir.c_str(), fid);
-                        FILE* fout = fopen(buf, "wb");
-                        if (!fout) {
-                            LOG_ERROR("open temp directory to save field information failed! [%s]", buf);
-                            exit(-1);
-                        }
-                        fwrite(idx_list, _item_count, sizeof(SortedIndex_t), fout);
-                        fclose(fout);
-                        _ffd[fid] = fopen(buf, "rb");
+                } else {
+                    _count_present(reader, &present);
+                }
 
-                        LOG_NOTICE("write feature file over [%s]", buf);
+                // features present in few items are kept as sparse columns,
+                // missing values of dense features are zeros.
+                // dense rows have no missing value.
+                vector<int> dense_fids;
+                vector<int> sparse_fids;
+                for (int fid=0; fid<_dim_count; ++fid) {
+                    if (!dense && _sparse_ratio > 0 && present[fid] <= _sparse_ratio * _item_count) {
+                        _is_sparse[fid] = true;
+                        sparse_fids.push_back(fid);
+                    } else {
+                        dense_fids.push_back(fid);
                     }
-
                 }
+                LOG_NOTICE("Preprocess: dense_feature=%d sparse_feature=%d (sparse_ratio=%.3f)",
+                        (int)dense_fids.size(), (int)sparse_fids.size(), _sparse_ratio);
 
-                // free memory.
-                delete [] idx_list;
-                for (int i=0; i<epoch_count; ++i) {
-                    delete [] ptr[i];
+                if (dense_fids.size() > 0) {
+                    _preprocess_dense(reader, dense_fids);
+                }
+                if (sparse_fids.size() > 0) {
+                    _preprocess_sparse(reader, sparse_fids, present);
                 }
-                delete [] ptr;
             }
         
+            if (_split_method == SM_Histogram) {
+                _build_bins();
+                return ;
+            }
+
             // temp: load all field in memory.
             LOG_NOTICE("Load SortedIndex from ffds..");
             _sorted_fields = new SortedIndex_t*[_dim_count];
             Timer tm;
             tm.begin();
 
+            _sparse_fields = new SparseColumn_t[_dim_count];
             for (int i=0; i<_dim_count; ++i) {
+                _sorted_fields[i] = NULL;
                 if (_feature_mask.find(i) != _feature_mask.end()) {
-                    _sorted_fields[i] = NULL;
+                    continue;
+                }
+                if (_is_sparse[i]) {
+                    _sparse_fields[i].read(_ffd[i]);
                     continue;
                 }
                 _sorted_fields[i] = new SortedIndex_t[_item_count];
@@ -790,10 +2444,26 @@ class GBDT_t
 
             ItemInfo_t* iinfo = new ItemInfo_t[_item_count];  // [item_id] : residual, in_which_node.
             Job_LayerFeatureProcess_t* jobs = new Job_LayerFeatureProcess_t[_dim_count];
-            pthread_t* tids = new pthread_t[_dim_count];
 
-            for (int D=0; D<_dim_count; ++D) {
-                jobs[D].tree = new TreeNode_t[_tree_size];
+            Job_LayerHistogram_t* hist_jobs = NULL;
+            NodeScan_t** thread_scan = NULL;
+            if (_split_method == SM_Histogram) {
+                hist_jobs = new Job_LayerHistogram_t[_dim_count];
+                for (int D=0; D<_dim_count; ++D) {
+                    hist_jobs[D].how = new char[1 << (_max_layer-1)];
+                }
+                _rows = new uint32_t[_item_count];
+                _row_residual = new float[_item_count];
+                _row_buffer = new uint32_t[_item_count];
+                _residual_buffer = new float[_item_count];
+            } else {
+                // nodes of one layer are at most 1<<(_max_layer-1),
+                // best-first growth scans the two children of a split.
+                int scan_size = (_max_leaves > 0) ? 2 : (1 << (_max_layer-1));
+                thread_scan = new NodeScan_t*[_pool->size()];
+                for (size_t i=0; i<_pool->size(); ++i) {
+                    thread_scan[i] = new NodeScan_t[scan_size];
+                }
             }
             // initialize target.
             for (size_t i=0; i<_item_count; ++i) {
@@ -818,6 +2488,10 @@ class GBDT_t
                 for (size_t i=0; i<_item_count; ++i) {
                     iinfo[i].in_which_node = 0;
                     if ( ITEM_SAMPLE(i) ) {
+                        if (_rows) {
+                            _rows[sample_item_count] = i;
+                            _row_residual[sample_item_count] = iinfo[i].residual;
+                        }
                         sample_item_count += 1;
                         root.sum += iinfo[i].residual;
                         root.square_sum += iinfo[i].residual * iinfo[i].residual;
@@ -834,207 +2508,911 @@ class GBDT_t
 
                 for (int i=0; i<_tree_size; ++i) {
                     _trees[T][i].fidx = -1;
+                    _trees[T][i].left = -1;
+                }
+
+                if (_max_leaves > 0) {
+                    _grow_leaf_wise(T, iinfo, locks, jobs, thread_scan);
                 }
 
                 // Each layer
-                for (int L=0; L<_max_layer; ++L) {
+                for (int L=0; _max_leaves<=0 && L<_max_layer; ++L) {
                     Timer multi_tm, post_tm;
 
-                    multi_tm.begin();
-                    int selected_feature_count = 0;
-                    for (int D=0; D<_dim_count; ++D) {
-                        // sample features.
-                        jobs[D].selected = false;
-                        jobs[D].dim_id_sorted = NULL;
+                    if (_split_method == SM_Histogram) {
+                        // layer is exactly the L-th layer of heap.
+                        beg_node = (1<<L) - 1;
+                        end_node = (1<<(L+1)) - 1;
+                        _histogram_layer(T, L, beg_node, end_node, iinfo, locks, hist_jobs, 
+                                &multi_tm, &post_tm);
+                    } else {
+                        multi_tm.begin();
+                        _find_splits(T, beg_node, end_node, iinfo, locks, jobs, thread_scan);
+                        for (int n=beg_node; n<end_node; ++n) {
+                            if (_trees[T][n].fidx >= 0) {
+                                _split_node(_trees[T], n, _L(n));
+                            }
+                        }
+                        multi_tm.end();
+
+                        post_tm.begin();
+                        _move_split_items(_trees[T], beg_node, end_node, iinfo);
 
-                        if (_feature_mask.find(D)!=_feature_mask.end()) {
-                            continue;
+                        post_tm.end();
+                    }
+
+                    for (int i=beg_node; i<end_node; ++i) {
+                        if (_trees[T][i].fidx>=0) {
+                            // accumlulate the score to the feature weight.
+                            _feature_weight[_trees[T][i].fidx] += _trees[T][i].score;
+
+                            if (all_node_count<=_trees[T][i].left + 1) {
+                                all_node_count = _trees[T][i].left + 2;
+                            }
                         }
+                    }
+
+                    float total_tm = multi_tm.cost_time() + post_tm.cost_time();
+                    LOG_NOTICE("T%d L%d multi=%.2f post=%.2f tm=%.2fs", 
+                            T, L, 
+                            multi_tm.cost_time(),
+                            post_tm.cost_time(),
+                            total_tm
+                        );
 
-                        if (_sample(_sample_feature) 
-                                && selected_feature_count<_dim_count*_sample_feature) 
-                        {
-                            jobs[D].master_tree = _trees[T];
-                            jobs[D].locks = locks;
-                            jobs[D].selected = true;
-                            jobs[D].item_count = _item_count;
-                            jobs[D].feature_index = D;
-                            jobs[D].beg_node = beg_node;
-                            jobs[D].end_node = end_node;
-                            jobs[D].all_node_count = all_node_count;
-                            jobs[D].finfo = _sorted_fields[D];
-                            jobs[D].iinfo = iinfo;
-                            jobs[D].dim_id_sorted = new int [sample_item_count];
-                            memcpy(jobs[D].tree, _trees[T], _tree_size * sizeof(TreeNode_t));
-
-                            selected_feature_count ++;
+                    // dump feature weight at each layer's ending.
+                    if (_output_feature_weight) {
+                        for (int i=0; i<_dim_count; ++i) {
+                            LOG_NOTICE("FWeight:\tT:%d\tL:%d\tF:%d\t%.5f", T, L, i, _feature_weight[i]);
                         }
                     }
-                    // calculation.
-                    multi_thread_jobs(__worker_layer_processor, jobs, _dim_count, _thread_num);
-                    multi_tm.end();
-
-                    post_tm.begin();
-
-                    for (int n=beg_node; n<end_node; ++n) {
-                        if (_trees[T][n].fidx >= 0) {
-                            int fidx = _trees[T][n].fidx;
-                            int* dim_id_sorted = jobs[fidx].dim_id_sorted;
-                            for (int i=_trees[T][n].begin; i<_trees[T][n].split; ++i) {
-                                _mm_prefetch(iinfo + dim_id_sorted[i+_PREFETCH_STEP_POST], _PREFETCH_TYPE);
-                                iinfo[ dim_id_sorted[i] ].in_which_node = _L(n);
-                            }
-                            for (int i=_trees[T][n].split; i<_trees[T][n].end; ++i) {
-                                _mm_prefetch(iinfo + dim_id_sorted[i+_PREFETCH_STEP_POST], _PREFETCH_TYPE);
-                                iinfo[ dim_id_sorted[i] ].in_which_node = _R(n);
-                            }
+
+                    // one layer forward.
+                    beg_node = end_node;
+                    end_node = all_node_count;
+                } // layer end.
+
+                Timer tree_finalize_tm;
+                tree_finalize_tm.begin();
+                for (int i=0; i<_tree_size; ++i) {
+                    TreeNode_t & node = _trees[T][i];
+                    if (node.cnt>0) {
+                        node.mean = node.sum / node.cnt;
+                    }
+                }
+
+                // update residual.
+                if (_rows) {
+                    _update_residual_by_rows(_trees[T], iinfo);
+                } else {
+                    for (uint32_t i=0; i<_item_count; ++i) {
+                        // sample out.
+                        if (!ITEM_SAMPLE(i)) {
+                            continue;
                         }
+                        float predict_value = _trees[T][iinfo[i].in_which_node].mean;
+                        iinfo[i].residual -= _sr * predict_value;
+                        //LOG_NOTICE("T=%d i=%d res=%f", T, i, iinfo[i].residual);
                     }
+                }
+                tree_finalize_tm.end();
 
+                tree_tm.end();
+                LOG_NOTICE("Training tree[%d] tm=%.2fs (finalize=%.2fs)", 
+                        T, tree_tm.cost_time(),
+                        tree_finalize_tm.cost_time());
 
-                    for (int i=beg_node; i<end_node; ++i) {
-                        if (_trees[T][i].fidx>=0) {
-                            // accumlulate the score to the feature weight.
-                            _feature_weight[_trees[T][i].fidx] += _trees[T][i].score;
+                if (_save_model_epoch>0 && (T+1)%_save_model_epoch == 0) {
+                    _rebuild_tree();
+                    // auto-save model.
+                    char fn[256];
+                    snprintf(fn, sizeof(fn), "%s/autosave.%04d.gbdt.model", _temp_dir.c_str(), T+1);
+                    FILE* autosave = fopen(fn, "w");
+                    if (!autosave) {
+                        LOG_ERROR("Fail to save autosave model. [%s]", fn);
+                    } else {
+                        write_model_epoch( autosave, T+1 );
+                        fclose(autosave);
+                    }
+                }
+            } // tree end.
+
+            // rebuild tree.
+            _rebuild_tree();
+            _build_predictor();
+            // auto-save model.
+            FILE* autosave = fopen((_temp_dir + "/autosave.gbdt.model").c_str(), "w");
+            if (!autosave) {
+                LOG_ERROR("Fail to save autosave model. [%s]", (_temp_dir + "/autosave.gbdt.model").c_str());
+            } else {
+                write_model( autosave );
+                fclose(autosave);
+            }
+
+            if (hist_jobs) {
+                for (int D=0; D<_dim_count; ++D) {
+                    delete [] hist_jobs[D].how;
+                }
+                delete [] hist_jobs;
+                delete [] _rows;
+                delete [] _row_residual;
+                delete [] _row_buffer;
+                delete [] _residual_buffer;
+                _rows = NULL;
+                _row_residual = NULL;
+                _row_buffer = NULL;
+                _residual_buffer = NULL;
+            }
+            if (thread_scan) {
+                for (size_t i=0; i<_pool->size(); ++i) {
+                    delete [] thread_scan[i];
+                }
+                delete [] thread_scan;
+            }
+            delete [] jobs;
+            delete [] iinfo;
+            delete [] locks;
+        }
+
+        int layer_num() const { return _max_layer; }
+        // leaf id in each tree is less than it.
+        size_t tree_node_count() const { 
+            if (_max_leaves > 0) {
+                return _tree_size;
+            }
+            return (1<< (_max_layer + 1)); 
+        }
+
+    private:
+        IReader_t* _reader;
+
+        int         _tree_count;
+        int         _max_layer;
+        int         _max_leaves;    // >0 : grow best-first, see _grow_leaf_wise().
+        int         _thread_num;
+        float       _sr;
+        ThreadPool_t* _pool;
+
+        string      _temp_dir;
+        bool        _load_cache;
+        int         _save_model_epoch;
+
+        float _sample_feature;
+        float _sample_instance;
+
+        int             _tree_size;
+        TreeNode_t**    _trees;  // node buffer.
+
+        ItemInfo_t*     _labels;
+
+        FILE**          _ffd;
+        SortedIndex_t** _sorted_fields;
+        SparseColumn_t* _sparse_fields;     // [fid] : used if _is_sparse[fid].
+        bool*           _is_sparse;
+        float           _sparse_ratio;
+
+        // histogram mode.
+        GBDTSplitMethod_t _split_method;
+        int             _max_bin;
+        FeatureBins_t*  _bins;          // [feature] : quantized column.
+        HistBin_t**     _hist;          // [feature] : histograms of two layers.
+        int*            _hist_stamp;    // [feature] : which layer is in _hist.
+        uint32_t        _histogram_chunk_size;
+        uint32_t*       _rows;          // row partition of current tree, see HistBin_t.
+        float*          _row_residual;
+        uint32_t*       _row_buffer;
+        float*          _residual_buffer;
+        vector<Job_HistogramChunk_t> _hist_chunks;
+
+        uint32_t  _item_count;
+        int     _dim_count;
+        size_t  _preprocess_maximum_memory;
+
+        SmallTreeNode_t** _compact_trees;
+        float**         _mean;
+
+        // debug feature weight.
+        float    *_feature_weight;
+        bool     _output_feature_weight;
+        bool     _feature_begin_at_0;
+        std::set<int> _feature_mask;
+        int      _predict_tree_cut;
+
+        GBDTPredictMethod_t _predict_method;
+        QuickScorer_t   _quick_scorer;
+        int             _simd_isa;
+        SimdScorer_t    _simd_scorer;
+        PackedForest_t  _packed_forest;     // walk of PM_Tree.
+
+        /*
+         * walk trees for rows of dense values, tree by tree.
+         */
+        void _walk_block(const float* buffer, size_t rows, int tree_count, float* out) const {
+            for (int T=0; T<tree_count; ++T) {
+                const SmallTreeNode_t* tree = _compact_trees[T];
+                const float* mean = _mean[T];
+                for (size_t r=0; r<rows; ++r) {
+                    const float* values = buffer + r * _dim_count;
+                    int nid = 0;
+                    while (tree[nid].fidx != -1) {
+                        const SmallTreeNode_t& node = tree[nid];
+                        float v = values[node.fidx];
+                        nid = node.left;
+                        if (v >= node.threshold || (v != v && !node.default_left)) {
+                            nid ++;
+                        }
+                    }
+                    out[r] += mean[nid];
+                }
+            }
+        }
+
+        /*
+         * node goes right on v >= threshold, NaN goes right only if
+         * !default_left, so it is written as !(v < threshold).
+         */
+        void _write_code_node(FILE* stream, int T, int nid, int depth) const {
+            const SmallTreeNode_t& node = _compact_trees[T][nid];
+            char buf[64];
+            if (node.fidx == -1) {
+                fprintf(stream, "%*sreturn %s;\n", depth * 4, "",
+                        _code_float(_mean[T][nid], buf, sizeof(buf)));
+                return ;
+            }
+            if (node.default_left) {
+                fprintf(stream, "%*sif (v[%d] >= %s) {\n", depth * 4, "",
+                        node.fidx, _code_float(node.threshold, buf, sizeof(buf)));
+            } else {
+                fprintf(stream, "%*sif (!(v[%d] < %s)) {\n", depth * 4, "",
+                        node.fidx, _code_float(node.threshold, buf, sizeof(buf)));
+            }
+            _write_code_node(stream, T, node.left + 1, depth + 1);
+            fprintf(stream, "%*s} else {\n", depth * 4, "");
+            _write_code_node(stream, T, node.left, depth + 1);
+            fprintf(stream, "%*s}\n", depth * 4, "");
+        }
+
+        // exact float literal: hex float, or builtin of inf/NaN.
+        static const char* _code_float(float v, char* buf, size_t size) {
+            if (v != v) {
+                snprintf(buf, size, "__builtin_nanf(\"\")");
+            } else if (v == std::numeric_limits<float>::infinity()) {
+                snprintf(buf, size, "__builtin_inff()");
+            } else if (v == -std::numeric_limits<float>::infinity()) {
+                snprintf(buf, size, "(-__builtin_inff())");
+            } else {
+                snprintf(buf, size, "%af", v);
+            }
+            return buf;
+        }
+
+        void _build_predictor() {
+            if (_compact_trees) {
+                _packed_forest.build(_compact_trees, _mean, _tree_count);
+            }
+            if (_predict_method == PM_QuickScorer && _compact_trees) {
+                _quick_scorer.build(_compact_trees, _mean, _tree_count, _dim_count);
+            }
+            if (_predict_method == PM_Simd && _compact_trees) {
+                _simd_scorer.build(_compact_trees, _mean, _tree_count, _tree_size, _simd_isa);
+            }
+        }
+
+        bool _sample(float ratio) const {
+            return ((random()%10000) / 10000.0) <= ratio;
+        }
+
+        size_t _hist_layer_size(int fid) const {
+            return (size_t)(1 << (_max_layer-1)) * _bins[fid].bin_num;
+        }
+
+        void _build_bins() {
+            Timer tm;
+            tm.begin();
+            LOG_NOTICE("Quantize features from ffds..");
+            _bins = new FeatureBins_t[_dim_count];
+            _hist = new HistBin_t*[_dim_count];
+            _hist_stamp = new int[_dim_count];
+
+            __GBDTBinJob_t* jobs = new __GBDTBinJob_t[_dim_count];
+            int job_count = 0;
+            for (int i=0; i<_dim_count; ++i) {
+                _hist[i] = NULL;
+                _hist_stamp[i] = -1;
+                if (_feature_mask.find(i) != _feature_mask.end()) {
+                    continue;
+                }
+                __GBDTBinJob_t& job = jobs[job_count++];
+                job.fid = i;
+                job.sorted_index_fd = _ffd[i];
+                job.sparse = _is_sparse[i];
+                job.count = _item_count;
+                job.max_bin = _max_bin;
+                job.bins = _bins + i;
+            }
+            _pool->run_jobs(__quantize_feature, jobs, job_count);
+            delete [] jobs;
+
+            size_t bin_memory = 0;
+            size_t wide_count = 0;
+            for (int i=0; i<_dim_count; ++i) {
+                if (_bins[i].bin_num > 0) {
+                    bin_memory += _bins[i].width * (size_t)_item_count;
+                    if (_bins[i].width > 1) {
+                        wide_count ++;
+                    }
+                }
+            }
+            tm.end();
+            LOG_NOTICE("quantize features over. max_bin=%d uint16_features=%lu bin_matrix=%.2fg (sorted_index=%.2fg) tm=%.2fs", 
+                    _max_bin, wide_count,
+                    bin_memory * 1. / (1<<30),
+                    job_count * sizeof(SortedIndex_t) * (size_t)_item_count * 1. / (1<<30),
+                    tm.cost_time());
+        }
+
+        /*
+         * read labels and count items having each feature.
+         */
+        void _count_present(IReader_t* reader, vector<uint32_t>* present) {
+            InstanceView_t item;
+            size_t item_id = 0;
+            int cur_per = 0;
+            reader->reset();
+            while (reader->read_view(&item)) {
+                _labels[item_id].residual = item.label;
+                for (size_t i=0; i<item.feature_num; ++i) {
+                    const IndValue_t& f = item.features[i];
+                    if (f.index>=0 && f.index<_dim_count) {
+                        (*present)[f.index] ++;
+                    }
+                }
+                item_id ++;
+
+                int per = reader->percentage();
+                if (per > cur_per) {
+                    cur_per = per;
+                    fprintf(stderr, "%c%4d%% counted..", 13, cur_per);
+                }
+            }
+            fprintf(stderr, "\n");
+        }
+
+        /*
+         * sort dense features in epochs bounded by preprocess_maximum_memory.
+         * feature fid is written to temp_dir/feature.<fid> as SortedIndex_t[_item_count].
+         */
+        void _preprocess_dense(IReader_t* reader, const vector<int>& fids) {
+            // column and buffer of radix sort.
+            size_t preprocess_memory_each_feature = 2 * sizeof(FeatureInfo_t) * _item_count;
+            size_t maximum_memory = _preprocess_maximum_memory * (1<<30);
+            int feature_num = (int)fids.size();
+            int epoch_count = (maximum_memory - 2*sizeof(SortedIndex_t)*_item_count) / preprocess_memory_each_feature;
+            if (epoch_count > feature_num) {
+                epoch_count = feature_num;
+            }
+            LOG_NOTICE("Preprocess: MemoryLimit=%dg EachFeatureRequired=%.2fg EpochCount=%d",
+                    _preprocess_maximum_memory,
+                    preprocess_memory_each_feature * 1. / (1<<30),
+                    epoch_count);
+
+            FeatureInfo_t **ptr = new FeatureInfo_t*[epoch_count];
+            for (int i=0; i<epoch_count; ++i) {
+                ptr[i] = new FeatureInfo_t[_item_count];
+            }
+            SortedIndex_t *idx_list = new SortedIndex_t[_item_count];
+
+            // [fid] : column of feature in this epoch, -1 if it is not in.
+            int* slot = new int[_dim_count];
+            for (int i=0; i<_dim_count; ++i) {
+                slot[i] = -1;
+            }
+
+            // dense rows are read by columns, not by read_view().
+            const DenseDataset_t* dense = reader->dense_data();
+            if (dense) {
+                dense->build_columns();
+            }
+
+            for (int epoch_begin=0; epoch_begin<feature_num; epoch_begin += epoch_count) {
+                InstanceView_t item;
+                size_t item_id = 0;
+                int cur_per = 0;
+                int feature_count = epoch_count;
+                if (epoch_begin + epoch_count > feature_num) {
+                    feature_count = feature_num - epoch_begin;
+                }
+                for (int i=0; i<feature_count; ++i) {
+                    slot[ fids[epoch_begin + i] ] = i;
+                }
+                LOG_NOTICE("Preproces epoch : feature_range=[%d, %d] count=%d", 
+                        fids[epoch_begin], fids[epoch_begin + feature_count - 1], feature_count);
 
-                            if (all_node_count<=_R(i)) {
-                                all_node_count = _R(i)+1;
-                            }
+                if (dense) {
+                    for (int i=0; i<feature_count; ++i) {
+                        int fid = fids[epoch_begin + i];
+                        const float* column = (fid < (int)dense->dim()) ? dense->column(fid) : NULL;
+                        for (size_t r=0; r<_item_count; ++r) {
+                            ptr[i][r].index = r;
+                            ptr[i][r].value = column ? column[r] : 0;
                         }
                     }
+                }
 
-                    for (int D=0; D<_dim_count; ++D) {
-                        if (jobs[D].dim_id_sorted) {
-                            delete [] jobs[D].dim_id_sorted;
+                reader->reset();
+                while (!dense && reader->read_view(&item)) {
+                    // some feature may be missing.
+                    // default value set to zero.
+                    for (int i=0; i<feature_count; ++i) {
+                        ptr[i][item_id].index = item_id;
+                        ptr[i][item_id].value = 0;
+                    }
+                    for (size_t i=0; i<item.feature_num; ++i) {
+                        const IndValue_t& f = item.features[i];
+                        if (f.index<0 || f.index>=_dim_count || slot[f.index]<0) {
+                            continue;
                         }
+                        ptr[ slot[f.index] ][item_id].value = f.value;
                     }
+                    item_id ++;
 
-                    post_tm.end();
-
-                    float total_tm = multi_tm.cost_time() + post_tm.cost_time();
-                    LOG_NOTICE("T%d L%d multi=%.2f post=%.2f tm=%.2fs", 
-                            T, L, 
-                            multi_tm.cost_time(),
-                            post_tm.cost_time(),
-                            total_tm
-                        );
+                    int per = reader->percentage();
+                    if (per > cur_per) {
+                        cur_per = per;
+                        fprintf(stderr, "%c%4d%% loaded..", 13, cur_per);
+                    }
+                }
+                fprintf(stderr, "\n");
 
-                    // dump feature weight at each layer's ending.
-                    if (_output_feature_weight) {
-                        for (int i=0; i<_dim_count; ++i) {
-                            LOG_NOTICE("FWeight:\tT:%d\tL:%d\tF:%d\t%.5f", T, L, i, _feature_weight[i]);
+                // features of this epoch are sorted together on _pool,
+                // a feature is sorted by parts if features are fewer than threads.
+                Timer sort_tm;
+                sort_tm.begin();
+                parallel_sort(_pool, ptr, feature_count, _item_count, __radix_sort_feature_part);
+                sort_tm.end();
+                LOG_NOTICE("sort %d feature(s) by %d thread(s) : %.3fs", 
+                        feature_count, (int)_pool->size(), sort_tm.cost_time());
+
+                for (int offset=0; offset<feature_count; ++offset) {
+                    int fid = fids[epoch_begin + offset];
+                    slot[fid] = -1;
+
+                    // set is_same flag.
+                    // if set, continuous item has same value(Cannot be splited)
+                    size_t diff_value = 0;
+                    for (size_t i=0; i<_item_count; ++i) {
+                        idx_list[i].index = ptr[offset][i].index;
+                        if (i>0 && ptr[offset][i].value == ptr[offset][i-1].value) {
+                            idx_list[i].same = 1;
+                        } else {
+                            idx_list[i].same = 0;
+                            diff_value ++;
                         }
                     }
+                    LOG_NOTICE("check same info feature=[%d] diff_value=%u over.", fid, diff_value);
 
-                    // one layer forward.
-                    beg_node = end_node;
-                    end_node = all_node_count;
-                } // layer end.
-
-                Timer tree_finalize_tm;
-                tree_finalize_tm.begin();
-                for (int i=0; i<_tree_size; ++i) {
-                    TreeNode_t & node = _trees[T][i];
-                    if (node.cnt>0) {
-                        node.mean = node.sum / node.cnt;
+                    char buf[256];
+                    snprintf(buf, sizeof(buf), "%s/feature.%d", _temp_dir.c_str(), fid);
+                    FILE* fout = fopen(buf, "wb");
+                    if (!fout) {
+                        LOG_ERROR("open temp directory to save field information failed! [%s]", buf);
+                        exit(-1);
                     }
+                    fwrite(idx_list, _item_count, sizeof(SortedIndex_t), fout);
+                    fclose(fout);
+                    _ffd[fid] = fopen(buf, "rb");
+
+                    LOG_NOTICE("write feature file over [%s]", buf);
                 }
+            }
 
-                // update residual.
-                for (uint32_t i=0; i<_item_count; ++i) {
-                    // sample out.
-                    if (!ITEM_SAMPLE(i)) {
-                        continue;
+            // free memory.
+            if (dense) {
+                dense->drop_columns();
+            }
+            delete [] slot;
+            delete [] idx_list;
+            for (int i=0; i<epoch_count; ++i) {
+                delete [] ptr[i];
+            }
+            delete [] ptr;
+        }
+
+        /*
+         * sort present values of sparse features, missing values are never materialised.
+         * features are read in groups bounded by preprocess_maximum_memory,
+         * feature fid is written to temp_dir/sparse.<fid> as a SparseColumn_t.
+         */
+        void _preprocess_sparse(IReader_t* reader, const vector<int>& fids, const vector<uint32_t>& present) {
+            size_t maximum_memory = _preprocess_maximum_memory * (1<<30);
+            int* slot = new int[_dim_count];
+            for (int i=0; i<_dim_count; ++i) {
+                slot[i] = -1;
+            }
+
+            size_t group_begin = 0;
+            while (group_begin < fids.size()) {
+                // present list and radix sort buffer of each feature.
+                size_t group_end = group_begin;
+                size_t group_memory = 0;
+                while (group_end < fids.size()) {
+                    size_t m = 2 * sizeof(FeatureInfo_t) * present[ fids[group_end] ];
+                    if (group_end > group_begin && group_memory + m > maximum_memory) {
+                        break;
                     }
-                    float predict_value = _trees[T][iinfo[i].in_which_node].mean;
-                    iinfo[i].residual -= _sr * predict_value;
-                    //LOG_NOTICE("T=%d i=%d res=%f", T, i, iinfo[i].residual);
+                    group_memory += m;
+                    group_end ++;
+                }
+                int feature_count = (int)(group_end - group_begin);
+                LOG_NOTICE("Preprocess sparse group : feature_range=[%d, %d] count=%d memory=%.2fg",
+                        fids[group_begin], fids[group_end-1], feature_count,
+                        group_memory * 1. / (1<<30));
+
+                __GBDTSparseJob_t* jobs = new __GBDTSparseJob_t[feature_count];
+                for (int k=0; k<feature_count; ++k) {
+                    int fid = fids[group_begin + k];
+                    slot[fid] = k;
+                    jobs[k].fid = fid;
+                    jobs[k].present = 0;
+                    jobs[k].list = new FeatureInfo_t[ present[fid] ];
+                    jobs[k].fd = NULL;
+                    snprintf(jobs[k].path, sizeof(jobs[k].path), "%s/sparse.%d", _temp_dir.c_str(), fid);
                 }
-                tree_finalize_tm.end();
 
-                tree_tm.end();
-                LOG_NOTICE("Training tree[%d] tm=%.2fs (finalize=%.2fs)", 
-                        T, tree_tm.cost_time(),
-                        tree_finalize_tm.cost_time());
+                InstanceView_t item;
+                size_t item_id = 0;
+                int cur_per = 0;
+                reader->reset();
+                while (reader->read_view(&item)) {
+                    for (size_t i=0; i<item.feature_num; ++i) {
+                        const IndValue_t& f = item.features[i];
+                        if (f.index<0 || f.index>=_dim_count || slot[f.index]<0) {
+                            continue;
+                        }
+                        __GBDTSparseJob_t& job = jobs[ slot[f.index] ];
+                        job.list[job.present].index = item_id;
+                        job.list[job.present].value = f.value;
+                        job.present ++;
+                    }
+                    item_id ++;
 
-                if (_save_model_epoch>0 && (T+1)%_save_model_epoch == 0) {
-                    _rebuild_tree();
-                    // auto-save model.
-                    char fn[256];
-                    snprintf(fn, sizeof(fn), "%s/autosave.%04d.gbdt.model", _temp_dir.c_str(), T+1);
-                    FILE* autosave = fopen(fn, "w");
-                    if (!autosave) {
-                        LOG_ERROR("Fail to save autosave model. [%s]", fn);
-                    } else {
-                        write_model_epoch( autosave, T+1 );
-                        fclose(autosave);
+                    int per = reader->percentage();
+                    if (per > cur_per) {
+                        cur_per = per;
+                        fprintf(stderr, "%c%4d%% loaded..", 13, cur_per);
                     }
                 }
-            } // tree end.
+                fprintf(stderr, "\n");
 
-            // rebuild tree.
-            _rebuild_tree();
-            // auto-save model.
-            FILE* autosave = fopen((_temp_dir + "/autosave.gbdt.model").c_str(), "w");
-            if (!autosave) {
-                LOG_ERROR("Fail to save autosave model. [%s]", (_temp_dir + "/autosave.gbdt.model").c_str());
-            } else {
-                write_model( autosave );
-                fclose(autosave);
+                Timer sort_tm;
+                sort_tm.begin();
+                _pool->run_jobs(__sort_sparse_feature, jobs, feature_count);
+                sort_tm.end();
+                LOG_NOTICE("sort %d sparse feature(s) by %d thread(s) : %.3fs", 
+                        feature_count, (int)_pool->size(), sort_tm.cost_time());
+
+                for (int k=0; k<feature_count; ++k) {
+                    slot[ jobs[k].fid ] = -1;
+                    _ffd[ jobs[k].fid ] = jobs[k].fd;
+                    delete [] jobs[k].list;
+                }
+                delete [] jobs;
+                group_begin = group_end;
             }
+            delete [] slot;
+        }
 
-            delete [] tids;
-            delete [] jobs;
-            delete [] iinfo;
-            delete [] locks;
+        /*
+         * find best split of nodes [beg_node, end_node) on sampled features.
+         */
+        void _find_splits(int T, int beg_node, int end_node, ItemInfo_t* iinfo, Lock_t* locks,
+                Job_LayerFeatureProcess_t* jobs, NodeScan_t** thread_scan)
+        {
+            int selected_feature_count = 0;
+            for (int D=0; D<_dim_count; ++D) {
+                // sample features.
+                jobs[D].selected = false;
+                jobs[D].sparse = NULL;
+
+                if (_feature_mask.find(D)!=_feature_mask.end()) {
+                    continue;
+                }
+
+                if (_sample(_sample_feature) 
+                        && selected_feature_count<_dim_count*_sample_feature) 
+                {
+                    jobs[D].master_tree = _trees[T];
+                    jobs[D].locks = locks;
+                    jobs[D].selected = true;
+                    jobs[D].item_count = _item_count;
+                    jobs[D].feature_index = D;
+                    jobs[D].beg_node = beg_node;
+                    jobs[D].end_node = end_node;
+                    jobs[D].finfo = _sorted_fields[D];
+                    jobs[D].iinfo = iinfo;
+                    jobs[D].thread_scan = thread_scan;
+                    if (_is_sparse[D]) {
+                        jobs[D].sparse = _sparse_fields + D;
+                    }
+
+                    selected_feature_count ++;
+                }
+            }
+            _pool->run_jobs(__worker_layer_feature, jobs, _dim_count);
         }
 
-        int layer_num() const { return _max_layer; }
-        size_t tree_node_count() const { return (1<< (_max_layer + 1)); }
+        /*
+         * create children of a node at [left, left+1] by its split.
+         */
+        void _split_node(TreeNode_t* tree, int n, int left) {
+            TreeNode_t& node = tree[n];
+            node.left = left;
 
-    private:
-        IReader_t* _reader;
+            tree[left].init(node.begin, node.split);
+            tree[left].sum = node.split_sum;
+            tree[left].square_sum = node.split_ssum;
 
-        int         _tree_count;
-        int         _max_layer;
-        int         _thread_num;
-        float       _sr;
+            tree[left+1].init(node.split, node.end);
+            tree[left+1].sum = node.sum - node.split_sum;
+            tree[left+1].square_sum = node.square_sum - node.split_ssum;
+        }
 
-        string      _temp_dir;
-        bool        _load_cache;
-        int         _save_model_epoch;
+        /*
+         * grow tree T best-first: the leaf whose split decreases squared error
+         * most is splitted, until there are _max_leaves leaves or no leaf can
+         * be splitted. children are appended to node store, so depth is not
+         * bounded by heap layout.
+         *  each split scans the sorted columns for its two children.
+         */
+        void _grow_leaf_wise(int T, ItemInfo_t* iinfo, Lock_t* locks,
+                Job_LayerFeatureProcess_t* jobs, NodeScan_t** thread_scan) 
+        {
+            TreeNode_t* tree = _trees[T];
+            int node_count = 1;
+            Timer multi_tm, post_tm;
+            multi_tm.begin();
+            _find_splits(T, 0, 1, iinfo, locks, jobs, thread_scan);
+            multi_tm.end();
+
+            int leaves = 1;
+            while (leaves < _max_leaves) {
+                int best = -1;
+                for (int n=0; n<node_count; ++n) {
+                    if (tree[n].fidx >= 0 && tree[n].left < 0 
+                            && (best < 0 || tree[n].gain > tree[best].gain)) 
+                    {
+                        best = n;
+                    }
+                }
+                if (best < 0) {
+                    break;
+                }
+                // accumlulate the score to the feature weight.
+                _feature_weight[tree[best].fidx] += tree[best].score;
 
-        float _sample_feature;
-        float _sample_instance;
+                post_tm.begin();
+                _split_node(tree, best, node_count);
+                _move_split_items(tree, best, best+1, iinfo);
+                post_tm.end();
 
-        int             _tree_size;
-        TreeNode_t**    _trees;  // node buffer.
+                multi_tm.begin();
+                _find_splits(T, node_count, node_count+2, iinfo, locks, jobs, thread_scan);
+                multi_tm.end();
 
-        ItemInfo_t*     _labels;
+                LOG_DEBUG("T%d leaf=%d split node=%d gain=%f", T, leaves+1, best, tree[best].gain);
+                node_count += 2;
+                leaves ++;
+            }
 
-        FILE**          _ffd;
-        SortedIndex_t** _sorted_fields;
+            // leaves with a split found but not applied.
+            for (int n=0; n<node_count; ++n) {
+                if (tree[n].left < 0) {
+                    tree[n].fidx = -1;
+                }
+            }
+            LOG_NOTICE("T%d leaves=%d multi=%.2f post=%.2f tm=%.2fs", 
+                    T, leaves,
+                    multi_tm.cost_time(),
+                    post_tm.cost_time(),
+                    multi_tm.cost_time() + post_tm.cost_time());
+            if (_output_feature_weight) {
+                for (int i=0; i<_dim_count; ++i) {
+                    LOG_NOTICE("FWeight:\tT:%d\tF:%d\t%.5f", T, i, _feature_weight[i]);
+                }
+            }
+        }
 
-        uint32_t  _item_count;
-        int     _dim_count;
-        size_t  _preprocess_maximum_memory;
+        /*
+         * move items of layer nodes to children.
+         *  each feature which wins some nodes ranks their items again
+         *  in its sorted column (one job per feature), then missing items
+         *  of nodes splitted on sparse features go to the default side.
+         */
+        void _move_split_items(const TreeNode_t* tree, int beg_node, int end_node, ItemInfo_t* iinfo) {
+            vector<Job_LayerMove_t> move_jobs;
+            vector<bool> winner(_dim_count, false);
+            vector<int> default_child(end_node, -1);
+            bool has_sparse_split = false;
+            for (int n=beg_node; n<end_node; ++n) {
+                int fidx = tree[n].fidx;
+                if (fidx < 0) {
+                    continue;
+                }
+                if (_is_sparse[fidx]) {
+                    default_child[n] = tree[n].default_left ? tree[n].left : tree[n].left + 1;
+                    has_sparse_split = true;
+                }
+                if (winner[fidx]) {
+                    continue;
+                }
+                winner[fidx] = true;
+
+                Job_LayerMove_t job;
+                job.feature_index = fidx;
+                job.beg_node = beg_node;
+                job.end_node = end_node;
+                job.item_count = _item_count;
+                job.finfo = _sorted_fields[fidx];
+                job.sparse = _is_sparse[fidx] ? _sparse_fields + fidx : NULL;
+                job.iinfo = iinfo;
+                job.tree = tree;
+                move_jobs.push_back(job);
+            }
+            if (move_jobs.size() > 0) {
+                _pool->run_jobs(__worker_layer_move, &move_jobs[0], move_jobs.size());
+            }
+            if (!has_sparse_split) {
+                return ;
+            }
 
-        SmallTreeNode_t** _compact_trees;
-        float**         _mean;
+            // present items are in children now, the rest are missing ones.
+            for (uint32_t i=0; i<_item_count; ++i) {
+                if (!ITEM_SAMPLE(i)) {
+                    continue;
+                }
+                int nid = iinfo[i].in_which_node;
+                if (nid >= beg_node && nid < end_node && default_child[nid] >= 0) {
+                    iinfo[i].in_which_node = default_child[nid];
+                }
+            }
+        }
 
-        // debug feature weight.
-        float    *_feature_weight;
-        bool     _output_feature_weight;
-        bool     _feature_begin_at_0;
-        std::set<int> _feature_mask;
-        int      _predict_tree_cut;
+        void _release_bins() {
+            if (_bins == NULL) {
+                return ;
+            }
+            for (int i=0; i<_dim_count; ++i) {
+                if (_hist[i]) delete [] _hist[i];
+            }
+            delete [] _bins;
+            delete [] _hist;
+            delete [] _hist_stamp;
+            _bins = NULL;
+        }
 
-        bool _sample(float ratio) const {
-            return ((random()%10000) / 10000.0) <= ratio;
+        /*
+         * process one layer by histogram.
+         *  1. build histograms and find best split for each selected feature.
+         *  2. move items to children of splitted nodes.
+         */
+        void _histogram_layer(int T, int L, int beg_node, int end_node, 
+                ItemInfo_t* iinfo, Lock_t* locks, Job_LayerHistogram_t* jobs,
+                Timer* multi_tm, Timer* post_tm)
+        {
+            multi_tm->begin();
+            TreeNode_t* tree = _trees[T];
+            int stamp = T * _max_layer + L;
+            int selected_feature_count = 0;
+            for (int D=0; D<_dim_count; ++D) {
+                Job_LayerHistogram_t& job = jobs[D];
+                job.selected = false;
+                if (_bins[D].bin_num == 0) {
+                    continue;
+                }
+                if (!_sample(_sample_feature)
+                        || selected_feature_count>=_dim_count*_sample_feature) 
+                {
+                    continue;
+                }
+                if (_hist[D] == NULL) {
+                    _hist[D] = new HistBin_t[2 * _hist_layer_size(D)];
+                }
+                job.selected = true;
+                job.item_count = _item_count;
+                job.feature_index = D;
+                job.layer = L;
+                job.beg_node = beg_node;
+                job.end_node = end_node;
+                job.bin_num = _bins[D].bin_num;
+                job.bins = _bins + D;
+                job.rows = _rows;
+                job.residual = _row_residual;
+                job.hist = _hist[D] + (L & 1) * _hist_layer_size(D);
+                job.parent_hist = NULL;
+                if (L>0 && _hist_stamp[D] == stamp - 1) {
+                    job.parent_hist = _hist[D] + ((L-1) & 1) * _hist_layer_size(D);
+                }
+                job.master_tree = tree;
+                job.locks = locks;
+                __histogram_plan(job);
+                _hist_stamp[D] = stamp;
+                selected_feature_count ++;
+
+                for (int n=beg_node; n<end_node; ++n) {
+                    if (job.how[n - beg_node] != 1) {
+                        continue;
+                    }
+                    const TreeNode_t& node = tree[n];
+                    for (uint32_t b=node.begin; b<(uint32_t)node.end; b+=_histogram_chunk_size) {
+                        Job_HistogramChunk_t chunk;
+                        chunk.job = &job;
+                        chunk.slot = n - beg_node;
+                        chunk.begin = b;
+                        chunk.end = b + _histogram_chunk_size;
+                        if (chunk.end > (uint32_t)node.end) {
+                            chunk.end = node.end;
+                        }
+                        chunk.whole = (chunk.begin == (uint32_t)node.begin && chunk.end == (uint32_t)node.end);
+                        _hist_chunks.push_back(chunk);
+                    }
+                }
+            }
+            if (_hist_chunks.size() > 0) {
+                _pool->run_jobs(__worker_histogram_chunk, &_hist_chunks[0], _hist_chunks.size());
+            }
+            _pool->run_jobs(__worker_layer_histogram, jobs, _dim_count);
+            _hist_chunks.clear();
+            multi_tm->end();
+
+            post_tm->begin();
+            vector<Job_HistogramPartition_t> parts;
+            for (int n=beg_node; n<end_node; ++n) {
+                if (tree[n].fidx < 0) {
+                    continue;
+                }
+                Job_HistogramPartition_t part;
+                part.tree = tree;
+                part.node = n;
+                part.bins = _bins + tree[n].fidx;
+                part.rows = _rows;
+                part.residual = _row_residual;
+                part.row_buffer = _row_buffer;
+                part.residual_buffer = _residual_buffer;
+                parts.push_back(part);
+            }
+            if (parts.size() > 0) {
+                _pool->run_jobs(__worker_histogram_partition, &parts[0], parts.size());
+            }
+            post_tm->end();
+        }
+
+        /*
+         * rows of each leaf are contiguous in row partition.
+         */
+        void _update_residual_by_rows(const TreeNode_t* tree, ItemInfo_t* iinfo) {
+            vector<bool> alive(_tree_size, false);
+            alive[0] = true;
+            for (int n=0; n<_tree_size; ++n) {
+                if (!alive[n]) {
+                    continue;
+                }
+                if (tree[n].fidx >= 0) {
+                    if (tree[n].left + 1 < _tree_size) {
+                        alive[tree[n].left] = true;
+                        alive[tree[n].left + 1] = true;
+                    }
+                    continue;
+                }
+                float predict_value = tree[n].mean;
+                for (int i=tree[n].begin; i<tree[n].end; ++i) {
+                    iinfo[ _rows[i] ].residual -= _sr * predict_value;
+                }
+            }
         }
 
         void _rebuild_tree() {
             // make-up missing value: threshold and mean.
+            // default direction of splits on dense features follows zero.
             Timer rebuild_tm; 
             rebuild_tm.begin();
             LOG_NOTICE("REBUILD_TREE: begin to recover node threshold.");
@@ -1042,7 +3420,7 @@ class GBDT_t
             for (int t=0; t<_tree_count; ++t) {
                 for (int i=0; i<_tree_size; ++i) {
                     TreeNode_t & node = _trees[t][i];
-                    if (node.fidx>=0) {
+                    if (node.fidx>=0 && node.split_id != THRESHOLD_READY_ID) {
                         ItemID_ReverseInfo_t item;
                         item.item_id = node.split_id;
                         item.tree_id = t;
@@ -1054,14 +3432,27 @@ class GBDT_t
 
             sort(reverse_array.begin(), reverse_array.end());
             // reading items. merge to node.
+            // dense rows are random accessed.
+            const DenseDataset_t* dense = _reader->dense_data();
             _reader->reset();
-            Instance_t item;
-            _reader->read(&item);
+            InstanceView_t item;
+            if (!dense) {
+                _reader->read_view(&item);
+            }
             uint32_t id = 0;
             for (size_t i=0; i<reverse_array.size(); ++i) {
                 const ItemID_ReverseInfo_t& info = reverse_array[i];
+                if (dense) {
+                    TreeNode_t& node = _trees[info.tree_id][info.node_id];
+                    node.threshold = 0.0;
+                    if (node.fidx < (int)dense->dim()) {
+                        node.threshold = dense->row(info.item_id)[node.fidx];
+                    }
+                    node.default_left = (0 < node.threshold);
+                    continue;
+                }
                 while (id<info.item_id) {
-                    if ( !_reader->read(&item) ) {
+                    if ( !_reader->read_view(&item) ) {
                         break;
                     }
                     id ++;
@@ -1074,12 +3465,14 @@ class GBDT_t
 
                 TreeNode_t& node = _trees[info.tree_id][info.node_id];
                 node.threshold = 0.0;
-                for (size_t f=0; f<item.features.size(); ++f) {
+                for (size_t f=0; f<item.feature_num; ++f) {
                     if (item.features[f].index == node.fidx) {
                         node.threshold = item.features[f].value;
                         break;
                     }
                 }
+                // missing values of dense features are zeros.
+                node.default_left = (0 < node.threshold);
             }
 
             // copy tree to compact_tree.
@@ -1098,6 +3491,150 @@ class GBDT_t
         }
 };
 
+/*
+ * GBDT model compiled to a shared object by GBDT_t::write_code(),
+ *  loaded by load() instead of read_model(), it can not be trained.
+ */
+class CompiledGBDT_t 
+    : public FlyModel_t
+{
+    typedef int   (*DimFunc_t)();
+    typedef float (*PredictFunc_t)(const float*, int);
+    typedef void  (*PredictBatchFunc_t)(const float*, int, int, int, float*);
+
+    public:
+        CompiledGBDT_t(const Config_t& config, const char* section):
+            _handle(NULL),
+            _dim_count(0),
+            _tree_count(0),
+            _predict_tree_cut(-1),
+            _predict_func(NULL),
+            _predict_batch_func(NULL)
+        {
+        }
+
+        virtual ~CompiledGBDT_t() {
+            if (_handle) {
+                dlclose(_handle);
+                _handle = NULL;
+            }
+        }
+
+        bool load(const char* so_file) {
+            // dlopen needs a path to search the file, not the library dirs.
+            string path = so_file;
+            if (path.find('/') == string::npos) {
+                path = "./" + path;
+            }
+            _handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+            if (_handle == NULL) {
+                LOG_ERROR("Cannot load compiled model [%s] : %s", so_file, dlerror());
+                return false;
+            }
+            DimFunc_t dim_func = (DimFunc_t)dlsym(_handle, "fly_gbdt_dim");
+            DimFunc_t tree_count_func = (DimFunc_t)dlsym(_handle, "fly_gbdt_tree_count");
+            _predict_func = (PredictFunc_t)dlsym(_handle, "fly_gbdt_predict");
+            _predict_batch_func = (PredictBatchFunc_t)dlsym(_handle, "fly_gbdt_predict_batch");
+            if (!dim_func || !tree_count_func || !_predict_func || !_predict_batch_func) {
+                LOG_ERROR("Compiled model [%s] misses fly_gbdt_* functions.", so_file);
+                dlclose(_handle);
+                _handle = NULL;
+                return false;
+            }
+            _dim_count = dim_func();
+            _tree_count = tree_count_func();
+            LOG_NOTICE("LOADING_INFO: compiled model [%s] tree_count=%d dim=%d", 
+                    so_file, _tree_count, _dim_count);
+            return true;
+        }
+
+        void set_predict_tree_cut(int N=-1) {
+            _predict_tree_cut = N;
+        }
+
+        int get_predict_tree_cut() const {
+            if (_predict_tree_cut == -1) {
+                return _tree_count;
+            }
+            return _predict_tree_cut;
+        }
+
+        virtual float predict(const Instance_t& ins) const {
+            float missing = std::numeric_limits<float>::quiet_NaN();
+            vector<float> values(_dim_count > 0 ? _dim_count : 1, missing);
+            for (size_t f=0; f<ins.features.size(); ++f) {
+                if (ins.features[f].index < _dim_count) {
+                    values[ins.features[f].index] = ins.features[f].value;
+                }
+            }
+            return _predict_func(&values[0], get_predict_tree_cut());
+        }
+
+        /*
+         * densify rows in blocks of about 1MB, the same as GBDT_t.
+         */
+        virtual void predict_batch(const InstanceBatch_t& rows, size_t n, float* out) const {
+            int dim = (_dim_count > 0) ? _dim_count : 1;
+            size_t block = (1 << 18) / dim;
+            if (block < 1) {
+                block = 1;
+            }
+            if (block > 256) {
+                block = 256;
+            }
+            float missing = std::numeric_limits<float>::quiet_NaN();
+            vector<float> buffer(block * dim, missing);
+            int tree_count = get_predict_tree_cut();
+            for (size_t begin=0; begin<n; begin+=block) {
+                size_t end = (begin + block < n) ? begin + block : n;
+                for (size_t r=begin; r<end; ++r) {
+                    float* values = &buffer[(r - begin) * dim];
+                    const IndValue_t* f = rows.features(r);
+                    for (size_t k=0; k<rows.feature_num(r); ++k) {
+                        if (f[k].index < _dim_count) {
+                            values[f[k].index] = f[k].value;
+                        }
+                    }
+                }
+                _predict_batch_func(&buffer[0], dim, end - begin, tree_count, out + begin);
+                for (size_t r=begin; r<end; ++r) {
+                    float* values = &buffer[(r - begin) * dim];
+                    const IndValue_t* f = rows.features(r);
+                    for (size_t k=0; k<rows.feature_num(r); ++k) {
+                        if (f[k].index < _dim_count) {
+                            values[f[k].index] = missing;
+                        }
+                    }
+                }
+            }
+        }
+
+        virtual void write_model(FILE* stream) const {
+            LOG_ERROR("Compiled GBDT model can not be written.");
+        }
+
+        virtual void read_model(FILE* stream) {
+            throw std::runtime_error("Compiled GBDT model is loaded by file name, use load().");
+        }
+
+        virtual void init(IReader_t* reader) {
+            throw std::runtime_error("Compiled GBDT model can not be trained.");
+        }
+
+        virtual void train() {
+            throw std::runtime_error("Compiled GBDT model can not be trained.");
+        }
+
+    private:
+        void*   _handle;
+        int     _dim_count;
+        int     _tree_count;
+        int     _predict_tree_cut;
+
+        PredictFunc_t       _predict_func;
+        PredictBatchFunc_t  _predict_batch_func;
+};
+
 #endif  //__GBDT_H_
 
 /* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
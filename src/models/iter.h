@@ -22,14 +22,36 @@ class Updatable_t {
     public:
         virtual ~Updatable_t() {};
         virtual float update(Instance_t& item) = 0;
+
+        /*
+         * update by a dense row: values[fid] for fid in [0, dim).
+         * default converts it to index:value, override for a dense path.
+         */
+        virtual float update_dense(float label, const float* values, size_t dim) {
+            _dense_item.label = label;
+            _dense_item.features.resize(dim);
+            IndValue_t* f = _dense_item.features.buffer();
+            for (size_t fid=0; fid<dim; ++fid) {
+                f[fid].index = fid;
+                f[fid].value = values[fid];
+            }
+            return update(_dense_item);
+        }
+
+    private:
+        Instance_t _dense_item;
 };
 
 struct JobUpdate_t {
     int job_id;
-    PCPool_t<Instance_t>* pool;
+    PCPool_t<InstanceBatch_t>* pool;
     IReader_t* reader;
     Updatable_t* updatable;
     double total_loss;
+
+    // dense path: workers take blocks of rows by next_block.
+    const DenseDataset_t* dense;
+    volatile size_t* next_block;
 };
 
 class IterModel_t: 
@@ -38,7 +60,8 @@ class IterModel_t:
     public:
         friend void* update_thread(void*);
 
-        IterModel_t (const Config_t& config, const char* section)
+        IterModel_t (const Config_t& config, const char* section):
+            _pool(NULL)
         {
             _config = &config;
 
@@ -58,8 +81,12 @@ class IterModel_t:
             LOG_NOTICE("_thread_num=%d", _thread_num);
         }
 
-        virtual ~IterModel_t() 
-        {}
+        virtual ~IterModel_t() {
+            if (_pool) {
+                delete _pool;
+                _pool = NULL;
+            }
+        }
 
         virtual void init(IReader_t* reader) {
             _reader = reader;
@@ -99,6 +126,7 @@ class IterModel_t:
         size_t  _iter_round;
         size_t  _cache_size;
         int     _thread_num;
+        ThreadPool_t* _pool; // 1 reader + (_thread_num-1) updaters, reused by epochs.
 
         const Config_t*  _config;
         IReader_t* _reader;
@@ -118,7 +146,11 @@ class IterModel_t:
         virtual void _join_updatable(Updatable_t**, size_t num) { /* do nothing. */ }
 
         float _epoch() {
-            PCPool_t<Instance_t>* ppool = new PCPool_t<Instance_t>(_cache_size);
+            if (_reader->dense_data() != NULL) {
+                return _dense_epoch();
+            }
+            PCPool_t<InstanceBatch_t>* ppool = new PCPool_t<InstanceBatch_t>(
+                    _cache_size / InstanceBatch_t::DefaultCapacity + 1);
             JobUpdate_t *jobs = new JobUpdate_t[_thread_num];
             Updatable_t** updatables = new Updatable_t*[_thread_num-1];
 
@@ -136,12 +168,17 @@ class IterModel_t:
                 }
                 jobs[i].pool = ppool;
                 jobs[i].total_loss = 0;
+                jobs[i].dense = NULL;
+                jobs[i].next_block = NULL;
             }
 
             _reader->reset();
             _epoch_begin();
 
-            multi_thread_jobs(update_thread, jobs, _thread_num, _thread_num);
+            if (_pool == NULL) {
+                _pool = new ThreadPool_t(_thread_num);
+            }
+            _pool->run_jobs(update_thread, jobs, _thread_num);
 
             double loss = 0;
             for (int i=1; i<_thread_num; ++i) {
@@ -160,22 +197,89 @@ class IterModel_t:
             delete [] jobs;
             return loss; 
         }
+
+        /*
+         * rows are in memory already, no reader thread:
+         *  updaters take blocks of dense rows themselves.
+         *  updater num is kept as (_thread_num-1), 
+         *  the same parameters are averaged by _join_updatable().
+         */
+        float _dense_epoch() {
+            const DenseDataset_t* dense = _reader->dense_data();
+            int worker_num = (_thread_num > 1) ? _thread_num - 1 : 1;
+            JobUpdate_t *jobs = new JobUpdate_t[worker_num];
+            Updatable_t** updatables = new Updatable_t*[worker_num];
+            volatile size_t next_block = 0;
+            for (int i=0; i<worker_num; ++i) {
+                jobs[i].job_id = i;
+                jobs[i].reader = NULL;
+                jobs[i].pool = NULL;
+                jobs[i].updatable = _new_updatable_object();
+                updatables[i] = jobs[i].updatable;
+                jobs[i].total_loss = 0;
+                jobs[i].dense = dense;
+                jobs[i].next_block = &next_block;
+            }
+
+            _reader->reset();
+            _epoch_begin();
+
+            if (_pool == NULL) {
+                _pool = new ThreadPool_t(_thread_num);
+            }
+            _pool->run_jobs(update_thread, jobs, worker_num);
+
+            double loss = 0;
+            for (int i=0; i<worker_num; ++i) {
+                loss += jobs[i].total_loss;
+            }
+            _join_updatable(updatables, worker_num);
+
+            LOG_NOTICE("TOTAL_LOSS=%f", loss);
+            loss = loss / _reader->size();
+            _epoch_loss = loss;
+            _epoch_end();
+            loss = _epoch_loss;
+
+            delete [] updatables;
+            delete [] jobs;
+            return loss; 
+        }
 };
 
 void* update_thread(void* c) {
     JobUpdate_t& job = *(JobUpdate_t*)c;
-    if (job.reader) {
+    if (job.dense) {
+        const DenseDataset_t& dense = *job.dense;
+        const size_t block_size = InstanceBatch_t::DefaultCapacity;
+        job.total_loss = 0;
+        size_t c = 0;
+        while (1) {
+            size_t begin = __sync_fetch_and_add(job.next_block, 1) * block_size;
+            if (begin >= dense.size()) {
+                break;
+            }
+            size_t end = min(begin + block_size, dense.size());
+            for (size_t i=begin; i<end; ++i) {
+                job.total_loss += job.updatable->update_dense(
+                        dense.label(i), dense.row(i), dense.dim());
+            }
+            c += end - begin;
+        }
+        LOG_NOTICE("update_thread[%d] : dense process over. %d item(s)", job.job_id, c);
+    } else if (job.reader) {
         LOG_NOTICE("thread[%d] : I am a reader.", job.job_id);
         size_t c = 0;
         while (1) {
-            Instance_t* cell = job.pool->begin_put();
-            if (!job.reader->read(cell)) {
-                job.pool->end_put(false);
+            InstanceBatch_t* cell = job.pool->begin_put();
+            size_t n = cell->fill(job.reader);
+            if (n == 0) {
+                job.pool->end_put(cell, false);
                 break;
             }
 
-            job.pool->end_put();
-            c ++;
+            job.pool->end_put(cell);
+            c += n;
         }
         LOG_NOTICE("reader: load over. count=%d", c);
         // end putting.
@@ -183,11 +287,16 @@ void* update_thread(void* c) {
     } else {
         LOG_NOTICE("thread[%d] : I am a slave.", job.job_id);
         Instance_t item;
+        InstanceBatch_t* batch;
         job.total_loss = 0;
         size_t c = 0;
-        while (job.pool->get(&item)) {
-            job.total_loss += job.updatable->update(item);
-            c ++;
+        while ((batch = job.pool->begin_get()) != NULL) {
+            for (size_t i=0; i<batch->size(); ++i) {
+                batch->get(i, &item);
+                job.total_loss += job.updatable->update(item);
+            }
+            c += batch->size();
+            job.pool->end_get(batch);
         }
         LOG_NOTICE("update_thread[%d] : process over. %d item(s)", job.job_id, c);
     }
@@ -55,6 +55,7 @@ class LogitSolver:
         ~LogitSolver();
 
         float update(Instance_t& item);
+        float update_dense(float label, const float* values, size_t dim);
 
     public:
         Param_t _theta;
@@ -69,6 +70,13 @@ class LogitSolver:
 
         RegularizationMethod_t _reg_method;
         float   _reg_weight;
+
+    private:
+        // buffer of online uniformed dense row.
+        FArray_t<float> _dense_buffer;
+
+        float _update_bias(float desc);
+        void  _update_weight(int index, float x, float desc, float cur_rate);
 };
 
 LogitSolver::~LogitSolver() {
@@ -100,7 +108,6 @@ float LogitSolver::update(Instance_t& item) {
         _uniform->self_uniform(&item);
     }
 
-    float cur_rate = _learn_rate;
     float p = sigmoid( sparse_dot(_theta, item.features) );
 
     // two types of LOSS.
@@ -128,6 +135,53 @@ float LogitSolver::update(Instance_t& item) {
     desc = -fake_y * min( 0.f, (1-fake_y*fake_p)/x_square );
     */
 
+    float cur_rate = _update_bias(desc);
+    for (size_t i=0; i<item.features.size(); ++i) {
+        int index = item.features[i].index;
+        if (index >= _theta_num) {
+            continue;
+        }
+        _update_weight(index, item.features[i].value, desc, cur_rate);
+    }
+
+    float loss = 0.0;
+    // Loss@MSE
+    //loss = 0.5 * (item.label - p) * (item.label - p);
+    // Loss@Log
+    loss = -(item.label * safe_log(p) + (1-item.label) * safe_log(1-p));
+    // Loss@Hinge
+    //loss = max(0., 1- 4. * (item.label - .5) * (p - .5));
+    return loss;
+}
+
+/*
+ * the same update as update() on a row with every feature present,
+ *  but without index:value list.
+ */
+float LogitSolver::update_dense(float label, const float* values, size_t dim) {
+    if (_uniform_method == OnlineUniform) {
+        _dense_buffer.resize(dim);
+        memcpy(_dense_buffer.buffer(), values, sizeof(float) * dim);
+        _uniform->self_uniform_dense(_dense_buffer.buffer(), dim);
+        values = _dense_buffer.buffer();
+    }
+
+    float p = sigmoid( dense_dot(_theta, values, dim) );
+    // desc@ MSE-loss, the same as update().
+    float desc = (label - p) * (1-p) * p;
+
+    float cur_rate = _update_bias(desc);
+    size_t n = min(dim, (size_t)_theta_num);
+    for (size_t fid=0; fid<n; ++fid) {
+        _update_weight(fid, values[fid], desc, cur_rate);
+    }
+    // Loss@Log
+    return -(label * safe_log(p) + (1-label) * safe_log(1-p));
+}
+
+// update bias, return learn rate of this step.
+float LogitSolver::_update_bias(float desc) {
+    float cur_rate = _learn_rate;
     float reg = 0;
 
     if (_decay_method == FeatureDecay || _decay_method == Decay) {
@@ -145,48 +199,37 @@ float LogitSolver::update(Instance_t& item) {
         reg = -0.5 * (_theta.b * _reg_weight);
     }
     _theta.b = _theta.b + (desc + reg) * cur_rate;
-    for (size_t i=0; i<item.features.size(); ++i) {
-        int index = item.features[i].index;
-        if (index >= _theta_num) {
-            continue;
-        }
-
-        float x = item.features[i].value;
-        float gradient = desc * x;
+    return cur_rate;
+}
 
-        if (_decay_method == FeatureDecay) {
-            _decay.w[index] += 1.0;
-            cur_rate = _learn_rate / (1.0 + sqrt(_decay.w[index]));
-        } else if (_decay_method == GradientFeatureDecay) {
-            _decay.w[index] += gradient * gradient;
-            cur_rate = _learn_rate / (1.0 + sqrt(_decay.w[index]));
-        }
+// cur_rate is rate of bias step, unless decay is per feature.
+void LogitSolver::_update_weight(int index, float x, float desc, float cur_rate) {
+    float gradient = desc * x;
+    float reg = 0;
 
-        if (_reg_method == RegNone) {
-            reg = 0;
-        } else if (_reg_method == RegL1) {
-            reg = - sgn(_theta.w[index]) * _reg_weight;
-        } else if (_reg_method == RegL2) {
-            reg = -0.5 * (_theta.w[index] * _reg_weight);
-        }
+    if (_decay_method == FeatureDecay) {
+        _decay.w[index] += 1.0;
+        cur_rate = _learn_rate / (1.0 + sqrt(_decay.w[index]));
+    } else if (_decay_method == GradientFeatureDecay) {
+        _decay.w[index] += gradient * gradient;
+        cur_rate = _learn_rate / (1.0 + sqrt(_decay.w[index]));
+    }
 
-        _theta.w[index] += (gradient + reg) * cur_rate;
+    if (_reg_method == RegNone) {
+        reg = 0;
+    } else if (_reg_method == RegL1) {
+        reg = - sgn(_theta.w[index]) * _reg_weight;
+    } else if (_reg_method == RegL2) {
+        reg = -0.5 * (_theta.w[index] * _reg_weight);
     }
 
-    float loss = 0.0;
-    // Loss@MSE
-    //loss = 0.5 * (item.label - p) * (item.label - p);
-    // Loss@Log
-    loss = -(item.label * safe_log(p) + (1-item.label) * safe_log(1-p));
-    // Loss@Hinge
-    //loss = max(0., 1- 4. * (item.label - .5) * (p - .5));
-    return loss;
+    _theta.w[index] += (gradient + reg) * cur_rate;
 }
 
 struct UniformerJob_t {
     int job_id;
     IReader_t* reader;
-    PCPool_t<Instance_t>* pool;
+    PCPool_t<InstanceBatch_t>* pool;
     MeanStdvar_Uniform* uniformer;
     ThreadData_t<FILE*>* output_fp;
 };
@@ -197,13 +240,14 @@ void* thread_uniformer(void* c) {
         LOG_NOTICE("thread[%d] : I am a reader.", job.job_id);
         size_t c = 0;
         while (1) {
-            Instance_t* cell = job.pool->begin_put();
-            if (!job.reader->read(cell)) {
-                job.pool->end_put(false);
+            InstanceBatch_t* cell = job.pool->begin_put();
+            size_t n = cell->fill(job.reader);
+            if (n == 0) {
+                job.pool->end_put(cell, false);
                 break;
             }
-            job.pool->end_put();
-            c ++;
+            job.pool->end_put(cell);
+            c += n;
         }
         LOG_NOTICE("reader: load over. count=%d", c);
         job.pool->set_putting(false);
@@ -211,13 +255,25 @@ void* thread_uniformer(void* c) {
     } else {
         LOG_NOTICE("thread[%d] : I am a worker.", job.job_id);
         Instance_t item;
+        InstanceBatch_t* batch;
+        InstanceBatch_t batch_out;
         int count = 0;
-        while (job.pool->get(&item)) {
-            job.uniformer->self_uniform(&item);
+        while ((batch = job.pool->begin_get()) != NULL) {
+            for (size_t i=0; i<batch->size(); ++i) {
+                batch->get(i, &item);
+                job.uniformer->self_uniform(&item);
+                batch_out.push_back(item);
+            }
+            // one lock for a whole batch.
             FILE* out = job.output_fp->borrow();
-            item.write_binary(out);
+            for (size_t i=0; i<batch_out.size(); ++i) {
+                batch_out.get(i, &item);
+                item.write_binary(out);
+            }
             job.output_fp->give_back();
-            count ++;
+            count += batch->size();
+            batch_out.clear();
+            job.pool->end_get(batch);
         }
         LOG_NOTICE("thread[%d] : over. %d processed.", job.job_id, count);
     }
@@ -377,11 +433,25 @@ class LogisticRegression_t
 
             // preprocess:
             //   - uniform.
-            if (_uniform_method == PreUniform) {
+            if (_uniform_method == PreUniform && reader->dense_data()) {
+                // dense rows are uniformed in memory, no temp file.
+                LOG_NOTICE("Begin to pre-uniform dense rows.");
+                const DenseDataset_t& in = *reader->dense_data();
+                DenseReader_t* dense_reader = new DenseReader_t();
+                DenseDataset_t& out = dense_reader->data();
+                out = in;
+                for (size_t i=0; i<out.size(); ++i) {
+                    _uniform.self_uniform_dense(out.mutable_row(i), out.dim());
+                }
+                LOG_NOTICE("End preprocess.");
+                _reader = dense_reader;
+                _reader->reset();
+            } else if (_uniform_method == PreUniform) {
                 LOG_NOTICE("Begin to pre-uniform.");
                 int thread_num = 11;
                 UniformerJob_t jobs[thread_num];
-                PCPool_t<Instance_t> *pool = new PCPool_t<Instance_t>(2000000);
+                PCPool_t<InstanceBatch_t> *pool = new PCPool_t<InstanceBatch_t>(
+                        2000000 / InstanceBatch_t::DefaultCapacity);
                 const char* temp_lr_file = "temp_lr_preprocess.bin";
                 FILE* output_file = fopen(temp_lr_file, "wb");
                 ThreadData_t<FILE*> *out = new ThreadData_t<FILE*>(output_file);
@@ -66,6 +66,10 @@ class MultiClassFakeReader_t
             return ret;
         }
 
+        virtual const FeatureStat_t* feature_stats() const {
+            return _reader->feature_stats();
+        }
+
     private:
         IReader_t* _reader;
         int         _class_id;
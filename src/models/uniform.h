@@ -45,14 +45,42 @@ class MeanStdvar_Uniform {
             memset(_max, 0, sizeof(float)*_dim_num);
             size_t n = 0;
 
+            const FeatureStat_t* stats = reader->feature_stats();
+            if (stats) {
+                // min/max come from file header. 
+                // absent features count as 0, the same as the pass below.
+                for (size_t fid=0; fid<_dim_num; ++fid) {
+                    if (stats[fid].count > 0) {
+                        _min[fid] = min(0.0f, stats[fid].min);
+                        _max[fid] = max(0.0f, stats[fid].max);
+                    }
+                }
+                LOG_NOTICE("UniformStat: use feature stats of reader.");
+                return ;
+            }
+
+            const DenseDataset_t* dense = reader->dense_data();
+            if (dense) {
+                size_t d = min(_dim_num, dense->dim());
+                for (size_t r=0; r<dense->size(); ++r) {
+                    const float* values = dense->row(r);
+                    for (size_t fid=0; fid<d; ++fid) {
+                        _min[fid] = min(_min[fid], values[fid]);
+                        _max[fid] = max(_max[fid], values[fid]);
+                    }
+                }
+                LOG_NOTICE("UniformStat: use dense rows of reader.");
+                return ;
+            }
+
             reader->reset();
-            Instance_t item;
-            while (reader->read(&item)) {
+            InstanceView_t item;
+            while (reader->read_view(&item)) {
                 n ++;
                 if (n % 1000000 == 0) {
                     fprintf(stderr, "%cUniformStat: %d item(s)", 13, n);
                 }
-                for (size_t i=0; i<item.features.size(); ++i) {
+                for (size_t i=0; i<item.feature_num; ++i) {
                     size_t fid = item.features[i].index;
                     float value = item.features[i].value;
                     if (fid >= 0 && fid < _dim_num) {
@@ -132,6 +160,22 @@ class MeanStdvar_Uniform {
             }
         }
 
+        // values[fid] is feature fid.
+        void self_uniform_dense(float* values, size_t dim) const {
+            size_t d = min(dim, _dim_num);
+            for (size_t fid=0; fid<d; ++fid) {
+                float mn = _min[fid];
+                float mx = _max[fid];
+                if (mx > mn) {
+                    float v = values[fid];
+                    if (v>mx) v=mx;
+                    else if (v<mn) v=mn; 
+                    values[fid] = (v - mn) / (mx - mn);
+                } else {
+                    values[fid] = 0; // never seen this feature.
+                }
+            }
+        }
 
         void debug() {
             // debug code.
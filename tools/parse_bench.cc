@@ -0,0 +1,173 @@
+/**
+ * @file parse_bench.cc
+ * @brief
+ *  micro-benchmark of text feature parsers:
+ *      the strtod/split based parsers vs. parse_item() on parse_int/parse_double.
+ *  both parsers run over the same lines, results are compared bit by bit.
+ *
+ **/
+
+#include "fly_core.h"
+
+/*
+ * reference parsers: the implementations parse_item() replaced.
+ */
+static bool ref_parse_indvalue(char* line, Instance_t* item) {
+    char* end_ptr;
+    item->label = strtod(line, &end_ptr);
+    if (end_ptr == line) {
+        return false;
+    }
+    item->features.clear();
+
+    size_t begin = 0;
+    IndValue_t iv;
+    iv.index = -1;
+    bool index_illegal = false;
+    for (size_t i=0; line[i]; ++i) {
+        if (line[i] == ':') {
+            iv.index = strtol(line + begin, &end_ptr, 10);
+            if (end_ptr == line+begin) {
+                return false;
+            }
+            begin = i+1;
+            index_illegal = true;
+        }
+        if (line[i] == ' ' || line[i] == '\t' || line[i]=='\n' || line[i]=='\r') {
+            if (!index_illegal) {
+                begin = i + 1;
+                continue;
+            }
+            iv.value = strtod(line + begin, &end_ptr);
+            if (end_ptr == line+begin || (end_ptr!=NULL && *end_ptr!=' ' && *end_ptr!='\n' && *end_ptr!='\t' && *end_ptr!='\r')) {
+                return false;
+            }
+            item->features.push_back(iv);
+            iv.index = -1;
+            index_illegal = false;
+            begin = i + 1;
+        }
+    }
+    return true;
+}
+
+static size_t ref_parse_values(char* line, CompactInstance_t* item) {
+    vector<string> flds;
+    split(line, " ", flds);
+
+    char* end_ptr;
+    float f = strtod(flds[0].c_str(), &end_ptr);
+    item->label = int(f+0.5);
+    size_t d = flds.size()-1;
+    if (item->values == NULL) {
+        item->set_dim(d);
+    }
+    for (size_t i=1; i<flds.size(); ++i) {
+        item->values[i-1] = strtod(flds[i].c_str(), &end_ptr);
+    }
+    return d;
+}
+
+static bool same_instance(const Instance_t& a, const Instance_t& b) {
+    if (memcmp(&a.label, &b.label, sizeof(float)) != 0 || a.features.size() != b.features.size()) {
+        return false;
+    }
+    return a.features.size()==0
+        || memcmp(a.features.buffer(), b.features.buffer(), sizeof(IndValue_t)*a.features.size()) == 0;
+}
+
+static bool same_compact(const CompactInstance_t& a, const CompactInstance_t& b) {
+    return a.label == b.label && a.dim == b.dim
+        && memcmp(a.values, b.values, sizeof(float)*a.dim) == 0;
+}
+
+int main(int argc, const char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <text_file> [<rounds> default=5]\n", argv[0]);
+        return -1;
+    }
+    int rounds = (argc > 2) ? atoi(argv[2]) : 5;
+
+    FILE* stream = fopen(argv[1], "r");
+    if (stream == NULL) {
+        LOG_ERROR("Cannot open file [%s]", argv[1]);
+        return -1;
+    }
+    vector<string> lines;
+    size_t total_bytes = 0;
+    char line[40960];
+    while (fgets(line, sizeof(line), stream)) {
+        lines.push_back(line);
+        total_bytes += lines.back().length();
+    }
+    fclose(stream);
+    if (lines.size() == 0) {
+        LOG_ERROR("empty file [%s]", argv[1]);
+        return -1;
+    }
+    TextReader_t::TextFeatureMode_t mode = TextReader_t::auto_detect_mode(lines[0].c_str());
+    if (mode != TextReader_t::TFM_IndValue && mode != TextReader_t::TFM_Values) {
+        LOG_ERROR("only IndValue and Values files are supported.");
+        return -1;
+    }
+    LOG_NOTICE("lines=%llu size=%.2fmb rounds=%d",
+            (unsigned long long)lines.size(), total_bytes / 1048576.0, rounds);
+
+    // check at first.
+    size_t mismatch = 0;
+    for (size_t i=0; i<lines.size(); ++i) {
+        strcpy(line, lines[i].c_str());
+        if (mode == TextReader_t::TFM_IndValue) {
+            Instance_t a, b;
+            a.label = b.label = 0;
+            ref_parse_indvalue(line, &a);
+            b.parse_item(lines[i].c_str());
+            mismatch += same_instance(a, b) ? 0 : 1;
+        } else {
+            CompactInstance_t a, b;
+            ref_parse_values(line, &a);
+            b.parse_item(lines[i].c_str(), " ");
+            mismatch += same_compact(a, b) ? 0 : 1;
+        }
+    }
+    LOG_NOTICE("mismatch lines: %llu", (unsigned long long)mismatch);
+
+    Timer ref_timer;
+    Timer fast_timer;
+    Instance_t item;
+    CompactInstance_t compact_item;
+    for (int r=0; r<rounds; ++r) {
+        ref_timer.begin();
+        for (size_t i=0; i<lines.size(); ++i) {
+            // copy is needed as split() writes the line.
+            strcpy(line, lines[i].c_str());
+            if (mode == TextReader_t::TFM_IndValue) {
+                ref_parse_indvalue(line, &item);
+            } else {
+                compact_item.clear();
+                ref_parse_values(line, &compact_item);
+            }
+        }
+        ref_timer.end();
+
+        fast_timer.begin();
+        for (size_t i=0; i<lines.size(); ++i) {
+            strcpy(line, lines[i].c_str());
+            if (mode == TextReader_t::TFM_IndValue) {
+                item.parse_item(line);
+            } else {
+                compact_item.clear();
+                compact_item.parse_item(line, " ");
+            }
+        }
+        fast_timer.end();
+    }
+
+    double mb = total_bytes * (double)rounds / 1048576.0;
+    LOG_NOTICE("strtod : %.3fs %.1fmb/s", ref_timer.cost_time(), mb / ref_timer.cost_time());
+    LOG_NOTICE("fast   : %.3fs %.1fmb/s", fast_timer.cost_time(), mb / fast_timer.cost_time());
+    LOG_NOTICE("speedup: %.2fx", ref_timer.cost_time() / fast_timer.cost_time());
+    return mismatch > 0 ? 1 : 0;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,138 @@
+/**
+ * @file predict_bench.cc
+ * @brief
+ *  micro-benchmark of GBDT evaluators on a saved model:
+ *      predict() per row vs. predict_batch() by tree walk, QuickScorer
+ *      and SIMD walk (scalar, AVX2, AVX-512 if cpu supports),
+ *      and the model compiled by `fly -C <file>.so` if it is given.
+ *  every evaluator is compared with predict() bit by bit.
+ *
+ **/
+
+#include "fly_core.h"
+#include "all_models.h"
+
+int main(int argc, const char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <gbdt_model> <text_file> [<rounds> default=3] [<compiled_model.so>]\n", argv[0]);
+        return -1;
+    }
+    int rounds = (argc > 3) ? atoi(argv[3]) : 3;
+
+    Config_t nil_config;
+    GBDT_t model(nil_config, "");
+    FILE* model_file = fopen(argv[1], "r");
+    if (model_file == NULL) {
+        LOG_ERROR("Cannot open model [%s]", argv[1]);
+        return -1;
+    }
+    model.read_model(model_file);
+    fclose(model_file);
+
+    TextReader_t reader(argv[2]);
+    vector<InstanceBatch_t*> batches;
+    size_t row_count = 0;
+    while (1) {
+        InstanceBatch_t* batch = new InstanceBatch_t();
+        if (batch->fill(&reader) == 0) {
+            delete batch;
+            break;
+        }
+        row_count += batch->size();
+        batches.push_back(batch);
+    }
+    LOG_NOTICE("rows=%llu rounds=%d", (unsigned long long)row_count, rounds);
+
+    // reference: predict() of each row.
+    vector<float> expect(row_count);
+    Timer ref_tm;
+    Instance_t item;
+    for (int r=0; r<rounds; ++r) {
+        size_t c = 0;
+        ref_tm.begin();
+        for (size_t b=0; b<batches.size(); ++b) {
+            for (size_t i=0; i<batches[b]->size(); ++i) {
+                batches[b]->get(i, &item);
+                expect[c++] = model.predict(item);
+            }
+        }
+        ref_tm.end();
+    }
+    LOG_NOTICE("%-16s %.3fs %.2fM rows/s", "predict",
+            ref_tm.cost_time(), row_count * rounds / ref_tm.cost_time() / 1e6);
+
+    struct Method_t {
+        const char* name;
+        GBDTPredictMethod_t method;
+        int isa;
+    } methods[] = {
+        {"batch_tree", PM_Tree, -1},
+        {"quickscorer", PM_QuickScorer, -1},
+        {"simd_scalar", PM_Simd, SimdScorer_t::ISA_Scalar},
+        {"simd_avx2", PM_Simd, SimdScorer_t::ISA_AVX2},
+        {"simd_avx512", PM_Simd, SimdScorer_t::ISA_AVX512},
+    };
+    size_t mismatch = 0;
+    vector<float> scores(row_count);
+    for (size_t m=0; m<sizeof(methods)/sizeof(methods[0]); ++m) {
+        if (methods[m].isa == SimdScorer_t::ISA_AVX2 && !__builtin_cpu_supports("avx2")) {
+            continue;
+        }
+        if (methods[m].isa == SimdScorer_t::ISA_AVX512 && !__builtin_cpu_supports("avx512f")) {
+            continue;
+        }
+        model.set_predict_method(methods[m].method, methods[m].isa);
+
+        Timer tm;
+        for (int r=0; r<rounds; ++r) {
+            size_t c = 0;
+            tm.begin();
+            for (size_t b=0; b<batches.size(); ++b) {
+                model.predict_batch(*batches[b], batches[b]->size(), &scores[c]);
+                c += batches[b]->size();
+            }
+            tm.end();
+        }
+        size_t diff = 0;
+        for (size_t i=0; i<row_count; ++i) {
+            diff += (memcmp(&scores[i], &expect[i], sizeof(float)) == 0) ? 0 : 1;
+        }
+        mismatch += diff;
+        LOG_NOTICE("%-16s %.3fs %.2fM rows/s (%.2fx) mismatch=%llu", methods[m].name,
+                tm.cost_time(), row_count * rounds / tm.cost_time() / 1e6,
+                ref_tm.cost_time() / tm.cost_time(), (unsigned long long)diff);
+    }
+
+    if (argc > 4) {
+        CompiledGBDT_t compiled(nil_config, "");
+        if (!compiled.load(argv[4])) {
+            return -1;
+        }
+        Timer tm;
+        for (int r=0; r<rounds; ++r) {
+            size_t c = 0;
+            tm.begin();
+            for (size_t b=0; b<batches.size(); ++b) {
+                compiled.predict_batch(*batches[b], batches[b]->size(), &scores[c]);
+                c += batches[b]->size();
+            }
+            tm.end();
+        }
+        size_t diff = 0;
+        for (size_t i=0; i<row_count; ++i) {
+            diff += (memcmp(&scores[i], &expect[i], sizeof(float)) == 0) ? 0 : 1;
+        }
+        mismatch += diff;
+        LOG_NOTICE("%-16s %.3fs %.2fM rows/s (%.2fx) mismatch=%llu", "compiled",
+                tm.cost_time(), row_count * rounds / tm.cost_time() / 1e6,
+                ref_tm.cost_time() / tm.cost_time(), (unsigned long long)diff);
+    }
+    LOG_NOTICE("mismatch rows: %llu", (unsigned long long)mismatch);
+
+    for (size_t b=0; b<batches.size(); ++b) {
+        delete batches[b];
+    }
+    return mismatch > 0 ? 1 : 0;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -136,6 +136,26 @@ static PyObject* load_gbdt_model(PyObject *self, PyObject *args)
     return Py_BuildValue("l",handle);
 }
 
+static PyObject* load_gbdt_so_model(PyObject *self, PyObject *args)
+{
+    char* so_file = NULL;
+    int res = PyArg_ParseTuple(args,"s", &so_file);
+    if (!res) {
+        fprintf(stderr, "parse args failed!\n");
+        return Py_BuildValue("l", -1);
+    }
+    Config_t nil_config;
+    CompiledGBDT_t* p_model = new CompiledGBDT_t(nil_config, "");
+
+    LOG_NOTICE("Try to load compiled model : [%s]", so_file);
+    if (!p_model->load(so_file)) {
+        delete p_model;
+        return Py_BuildValue("l", -1);
+    }
+    long int handle = (long int)(FlyModel_t*)p_model;
+    return Py_BuildValue("l",handle);
+}
+
 static PyObject* load_lr_model(PyObject *self, PyObject *args)
 {
     char* model_file = NULL;
@@ -169,14 +189,28 @@ static PyObject* release(PyObject *self, PyObject *args)
     return Py_BuildValue("l", 1);
 }
 
+static PyObject* release_so(PyObject *self, PyObject *args)
+{
+    long int handle;
+    int res = PyArg_ParseTuple(args, "l", &handle);
+    if (!res) {
+        fprintf(stderr, "parse release handle failed!\n");    
+    }
+    CompiledGBDT_t* p_model = (CompiledGBDT_t*)(FlyModel_t*)handle;
+    delete p_model;
+    return Py_BuildValue("l", 1);
+}
+
 static PyMethodDef PyFlyMethods[]={
     {"load_gbdt",load_gbdt_model,METH_VARARGS},
     {"load_gbdt_cut",load_gbdt_model_cutted,METH_VARARGS},
+    {"load_gbdt_so", load_gbdt_so_model, METH_VARARGS},
     {"load_lr", load_lr_model, METH_VARARGS},
     {"predict_str",predict_str, METH_VARARGS},
     {"predict", predict, METH_VARARGS},
     {"tree_features",tree_features,METH_VARARGS},
     {"release_trees",release,METH_VARARGS},
+    {"release_gbdt_so",release_so,METH_VARARGS},
     {NULL,NULL}
 };
 
@@ -0,0 +1,132 @@
+/**
+ * @file sort_bench.cc
+ * @brief
+ *  micro-benchmark of GBDT feature column sorting:
+ *      std::sort by FeatureInfo_t::operator < vs. radix_sort_float,
+ *      single thread and parallel_sort() on a pool.
+ *  every sorted column is compared with the std::sort one.
+ *
+ **/
+
+#include "fly_core.h"
+#include "all_models.h"
+
+enum ValueDist_t {
+    VD_Uniform = 0,     // random floats in [-1, 1].
+    VD_FewValues,       // 16 distinct values, many ties.
+    VD_Sparse,          // 90% zeros (-0.0 included).
+};
+
+static void fill_column(FeatureInfo_t* col, size_t n, ValueDist_t dist) {
+    for (size_t i=0; i<n; ++i) {
+        col[i].index = i;
+        float r = rand() / (float)RAND_MAX;
+        if (dist == VD_Uniform) {
+            col[i].value = r * 2 - 1;
+        } else if (dist == VD_FewValues) {
+            col[i].value = int(r * 16) * 0.25f - 2.0f;
+        } else {
+            col[i].value = (r < 0.9) ? ((i & 1) ? -0.0f : 0.0f) : r;
+        }
+    }
+}
+
+static bool same_column(const FeatureInfo_t* a, const FeatureInfo_t* b, size_t n) {
+    for (size_t i=0; i<n; ++i) {
+        if (a[i].index != b[i].index || a[i].value != b[i].value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, const char** argv) {
+    size_t n = (argc > 1) ? atoi(argv[1]) : 1000000;
+    size_t feature_num = (argc > 2) ? atoi(argv[2]) : 4;
+    size_t thread_num = (argc > 3) ? atoi(argv[3]) : 4;
+    if (n == 0 || feature_num == 0) {
+        fprintf(stderr, "Usage: %s [<rows> default=1000000] [<features> default=4] [<threads> default=4]\n", argv[0]);
+        return -1;
+    }
+    LOG_NOTICE("rows=%llu features=%llu threads=%llu",
+            (unsigned long long)n, (unsigned long long)feature_num, (unsigned long long)thread_num);
+
+    const char* dist_name[] = {"uniform", "few_values", "sparse"};
+    ThreadPool_t pool(thread_num);
+    FeatureInfo_t* buffer = new FeatureInfo_t[n];
+    FeatureInfo_t** origin = new FeatureInfo_t*[feature_num];
+    FeatureInfo_t** expect = new FeatureInfo_t*[feature_num];
+    FeatureInfo_t** cols = new FeatureInfo_t*[feature_num];
+    for (size_t k=0; k<feature_num; ++k) {
+        origin[k] = new FeatureInfo_t[n];
+        expect[k] = new FeatureInfo_t[n];
+        cols[k] = new FeatureInfo_t[n];
+    }
+
+    size_t mismatch = 0;
+    for (int d=VD_Uniform; d<=VD_Sparse; ++d) {
+        for (size_t k=0; k<feature_num; ++k) {
+            fill_column(origin[k], n, (ValueDist_t)d);
+        }
+
+        Timer std_tm;
+        std_tm.begin();
+        for (size_t k=0; k<feature_num; ++k) {
+            memcpy(expect[k], origin[k], sizeof(FeatureInfo_t) * n);
+            sort(expect[k], expect[k] + n);
+        }
+        std_tm.end();
+
+        Timer radix_tm;
+        radix_tm.begin();
+        for (size_t k=0; k<feature_num; ++k) {
+            memcpy(cols[k], origin[k], sizeof(FeatureInfo_t) * n);
+            __radix_sort_feature_part(cols[k], cols[k] + n, buffer);
+        }
+        radix_tm.end();
+        for (size_t k=0; k<feature_num; ++k) {
+            mismatch += same_column(cols[k], expect[k], n) ? 0 : 1;
+        }
+
+        Timer pstd_tm;
+        for (size_t k=0; k<feature_num; ++k) {
+            memcpy(cols[k], origin[k], sizeof(FeatureInfo_t) * n);
+        }
+        pstd_tm.begin();
+        parallel_sort(&pool, cols, feature_num, n);
+        pstd_tm.end();
+        for (size_t k=0; k<feature_num; ++k) {
+            mismatch += same_column(cols[k], expect[k], n) ? 0 : 1;
+        }
+
+        Timer pradix_tm;
+        for (size_t k=0; k<feature_num; ++k) {
+            memcpy(cols[k], origin[k], sizeof(FeatureInfo_t) * n);
+        }
+        pradix_tm.begin();
+        parallel_sort(&pool, cols, feature_num, n, __radix_sort_feature_part);
+        pradix_tm.end();
+        for (size_t k=0; k<feature_num; ++k) {
+            mismatch += same_column(cols[k], expect[k], n) ? 0 : 1;
+        }
+
+        LOG_NOTICE("%-10s std::sort=%.3fs radix=%.3fs (%.2fx) | parallel std::sort=%.3fs radix=%.3fs (%.2fx)",
+                dist_name[d],
+                std_tm.cost_time(), radix_tm.cost_time(), std_tm.cost_time() / radix_tm.cost_time(),
+                pstd_tm.cost_time(), pradix_tm.cost_time(), pstd_tm.cost_time() / pradix_tm.cost_time());
+    }
+    LOG_NOTICE("mismatch columns: %llu", (unsigned long long)mismatch);
+
+    for (size_t k=0; k<feature_num; ++k) {
+        delete [] origin[k];
+        delete [] expect[k];
+        delete [] cols[k];
+    }
+    delete [] origin;
+    delete [] expect;
+    delete [] cols;
+    delete [] buffer;
+    return mismatch > 0 ? 1 : 0;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
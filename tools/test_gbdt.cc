@@ -19,7 +19,7 @@
 
 struct TestJob_t {
     int job_id;
-    PCPool_t<Instance_t>* pool;
+    PCPool_t<InstanceBatch_t>* pool;
     IReader_t* reader;
     FArray_t<ResultPair_t> ans_list;
     GBDT_t* model;
@@ -36,22 +36,23 @@ void* thread_test(void* c) {
     int tree_count = job.model->get_predict_tree_cut();
     int* leaves = new int [tree_count];
     float* means = new float [tree_count];
-    float* buffer = new float[tree_count];
+    float* buffer = new float[job.model->dim()];
 
     if (job.reader) {
         LOG_NOTICE("test_gbdt: thread[%d] : I am a reader.", job.job_id);
         size_t c = 0;
         while (1) {
-            Instance_t* cell = job.pool->begin_put();
-            if (!job.reader->read(cell)) {
-                job.pool->end_put(false);
+            InstanceBatch_t* cell = job.pool->begin_put();
+            size_t n = cell->fill(job.reader);
+            if (n == 0) {
+                job.pool->end_put(cell, false);
                 break;
             }
-            if (c % 2000000 == 0) {
-                LOG_NOTICE("complete %d puts.", c);
+            if (c / 2000000 != (c + n) / 2000000) {
+                LOG_NOTICE("complete %d puts.", c + n);
             }
-            job.pool->end_put();
-            c ++;
+            job.pool->end_put(cell);
+            c += n;
         }
         LOG_NOTICE("test_gbdt: reader: load over. count=%d", c);
         job.pool->set_putting(false);
@@ -59,10 +60,23 @@ void* thread_test(void* c) {
         LOG_NOTICE("test_gbdt: thread[%d] : I am a worker.", job.job_id);
         job.ans_list.clear();
         Instance_t item(1200);
-        while (job.pool->get(&item)) {
-            float ans;
-            if (job.binary_output) {
-                ans = job.model->predict_and_get_leaves(item, leaves, means, buffer);
+        vector<float> scores(InstanceBatch_t::DefaultCapacity);
+        InstanceBatch_t* batch;
+        while ((batch = job.pool->begin_get()) != NULL) {
+            if (!job.binary_output) {
+                if (scores.size() < batch->size()) {
+                    scores.resize(batch->size());
+                }
+                job.model->predict_batch(*batch, batch->size(), &scores[0]);
+                for (size_t b=0; b<batch->size(); ++b) {
+                    job.ans_list.push_back(ResultPair_t(batch->label(b), scores[b]));
+                }
+                job.pool->end_get(batch);
+                continue;
+            }
+            for (size_t b=0; b<batch->size(); ++b) {
+                batch->get(b, &item);
+                float ans = job.model->predict_and_get_leaves(item, leaves, means, buffer);
                 // make it sparse.
                 for (int i=0; i<tree_count; ++i) {
                     IndValue_t iv; 
@@ -88,10 +102,9 @@ void* thread_test(void* c) {
                 FILE* output_fp = job.binary_output->borrow();
                 item.write_binary(output_fp);
                 job.binary_output->give_back();
-            } else {
-                ans = job.model->predict(item);
+                job.ans_list.push_back(ResultPair_t(item.label, ans));
             }
-            job.ans_list.push_back(ResultPair_t(item.label, ans));
+            job.pool->end_get(batch);
         }
 
         LOG_NOTICE("thread[%d] : over. %d processed.", job.job_id, job.ans_list.size());
@@ -106,7 +119,7 @@ float test_auc(IReader_t* treader, GBDT_t* model, FILE* dump_feature_binary_file
     // 1 reader + N workers.
     thread_num += 1;
     TestJob_t* jobs = new TestJob_t[thread_num];
-    PCPool_t<Instance_t> pool(2000000);
+    PCPool_t<InstanceBatch_t> pool(2000000 / InstanceBatch_t::DefaultCapacity);
     ThreadData_t<FILE*>* output_data = NULL;
     if (dump_feature_binary_file) {
         output_data = new ThreadData_t<FILE*>(dump_feature_binary_file);
@@ -146,10 +159,11 @@ float test_auc(IReader_t* treader, GBDT_t* model, FILE* dump_feature_binary_file
 
 int main(int argc, char** argv) {
     if (argc <= 2) {
-        fprintf(stderr, "Usage: %s <model> <test_file> [<tree_interval> <tree_total>] -D[binary_output] -C[tree_cut] [-m] [-p] [-tN default=5]\n\n", argv[0]);
+        fprintf(stderr, "Usage: %s <model> <test_file> [<tree_interval> <tree_total>] -D[binary_output] -C[tree_cut] [-m] [-p] [-tN default=5] [-q]\n\n", argv[0]);
         fprintf(stderr, "  -m : output mean, other wise output 0/1.\n");
         fprintf(stderr, "  -p : if -Doutput_file is set, output the path-info.\n");
         fprintf(stderr, "  -t : thread num.\n");
+        fprintf(stderr, "  -q : score with QuickScorer evaluator.\n");
         return -1;
     }
 
@@ -157,6 +171,7 @@ int main(int argc, char** argv) {
     int tree_cut = 0;
     bool output_mean = false;
     bool output_path = false;
+    bool quick_scorer = false;
     for (int i=1; i<argc; ++i) {
         if ( strcmp(argv[i], "-m")==0 ) {
             output_mean = true;
@@ -166,6 +181,10 @@ int main(int argc, char** argv) {
             output_path = true;
             LOG_NOTICE("Output path-in-tree feature.");
         }
+        if ( strcmp(argv[i], "-q")==0 ) {
+            quick_scorer = true;
+            LOG_NOTICE("Predict by QuickScorer.");
+        }
         if ( strstr(argv[i], "-C")!=NULL ) {
             tree_cut = atoi(argv[i]+2);
             LOG_NOTICE("TreeCut: %d", tree_cut);
@@ -210,6 +229,9 @@ int main(int argc, char** argv) {
     FILE* model_file = fopen(model_name, "r");
     model->read_model(model_file);
     fclose(model_file);
+    if (quick_scorer) {
+        model->set_predict_method(PM_QuickScorer);
+    }
  
     // simple test on training set.
     IReader_t *treader = test_data_reader;